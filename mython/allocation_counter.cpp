@@ -0,0 +1,59 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace runtime {
+
+namespace {
+// Поле count_ самого внутреннего AllocationCounter потока. Вне тестов - nullptr,
+// и operator new обходится одной проверкой без атомарных операций
+thread_local size_t* active_count = nullptr;
+}  // namespace
+
+AllocationCounter::AllocationCounter()
+    : previous_(active_count) {
+    active_count = &count_;
+}
+
+AllocationCounter::~AllocationCounter() {
+    active_count = previous_;
+    if (previous_ != nullptr) {
+        *previous_ += count_;
+    }
+}
+
+size_t AllocationCounter::Count() const {
+    return count_;
+}
+
+}  // namespace runtime
+
+void* operator new(size_t size) {
+    if (size_t* count = runtime::active_count) {
+        ++*count;
+    }
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// Память выделена через malloc в заменённом operator new, поэтому free - парная функция.
+// GCC считает указатель полученным от стандартного operator new и предупреждает зря
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept {
+    std::free(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+namespace runtime {
+
+// Считает выделения памяти в куче, которые делает текущий поток, пока счётчик жив.
+// Нужен тестам, проверяющим, что операция не выделяет память. Пока ни один счётчик
+// не установлен, operator new ничего не считает
+class AllocationCounter {
+public:
+    AllocationCounter();
+    ~AllocationCounter();
+
+    AllocationCounter(const AllocationCounter&) = delete;
+    AllocationCounter& operator=(const AllocationCounter&) = delete;
+
+    [[nodiscard]] size_t Count() const;
+
+private:
+    size_t count_ = 0;
+    // Счётчик, установленный раньше этого: ему тоже достаются выделения
+    size_t* previous_;
+};
+
+}  // namespace runtime
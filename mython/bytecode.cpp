@@ -0,0 +1,849 @@
+#include "bytecode.h"
+
+#include <iterator>
+#include <typeinfo>
+#include <unordered_map>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MYTHON_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define MYTHON_NOINLINE __declspec(noinline)
+#else
+#define MYTHON_NOINLINE
+#endif
+
+using namespace std;
+
+namespace ast {
+
+using runtime::Closure;
+using runtime::Context;
+using runtime::ObjectHolder;
+
+namespace {
+[[noreturn]] MYTHON_NOINLINE void ThrowUndefinedVariable() {
+    throw runtime_error("VariableValue fail"s);
+}
+
+ObjectHolder LookUp(const Closure& closure, const string& name) {
+    if (auto it = closure.find(name); it != closure.end()) {
+        return it->second;
+    }
+    ThrowUndefinedVariable();
+}
+
+runtime::ClassInstance& AsInstance(const ObjectHolder& object, const char* error) {
+    auto* instance = object.TryAs<runtime::ClassInstance>();
+    if (instance == nullptr) {
+        throw runtime_error(error);
+    }
+    return *instance;
+}
+
+void PrintValue(const ObjectHolder& object, ostream& os, Context& context) {
+    if (!object) {
+        os << "None"sv;
+    } else {
+        object->Print(os, context);
+    }
+}
+}  // namespace
+
+class BytecodeCompiler {
+public:
+    using Op = Bytecode::Op;
+
+    explicit BytecodeCompiler(Bytecode& code)
+        : code_(code) {
+    }
+
+    // Тело метода: self и параметры занимают первые ячейки кадра
+    BytecodeCompiler(Bytecode& code, const vector<string>& formal_params)
+        : code_(code)
+        , method_(true) {
+        Slot("self"s);
+        for (const auto& param : formal_params) {
+            code_.param_slots_.push_back(Slot(param));
+        }
+    }
+
+    void Build(unique_ptr<Statement>& statement) {
+        if (statement && typeid(*statement) == typeid(MethodBody)) {
+            code_.method_ = true;
+            Emit(static_cast<MethodBody&>(*statement).GetBody());
+            Emit(Op::POP);
+            Emit(Op::NONE);
+        } else {
+            Emit(statement);
+        }
+        Emit(Op::LEAVE);
+
+        if (method_ && code_.method_ && !needs_closure_) {
+            code_.frame_size_ = static_cast<uint32_t>(slot_names_.size());
+            return;
+        }
+        // Кадр не используется: переменные ищутся по имени
+        code_.param_slots_.clear();
+        for (auto& instruction : code_.code_) {
+            if (instruction.op == Op::LOAD_LOCAL || instruction.op == Op::STORE_LOCAL) {
+                instruction.op = instruction.op == Op::LOAD_LOCAL ? Op::LOAD_NAME : Op::STORE_NAME;
+                instruction.arg = slot_names_[instruction.arg];
+            }
+        }
+    }
+
+private:
+    void Emit(unique_ptr<Statement>& statement) {
+        if (!statement) {
+            Emit(Op::NONE);
+            return;
+        }
+        Statement& node = *statement;
+        const type_info& type = typeid(node);
+
+        if (type == typeid(VariableValue)) {
+            EmitVariable(static_cast<VariableValue&>(node));
+        } else if (type == typeid(NumericConst)) {
+            EmitConstant(static_cast<NumericConst&>(node));
+        } else if (type == typeid(StringConst)) {
+            EmitConstant(static_cast<StringConst&>(node));
+        } else if (type == typeid(BoolConst)) {
+            EmitConstant(static_cast<BoolConst&>(node));
+        } else if (type == typeid(MethodCall)) {
+            auto& call = static_cast<MethodCall&>(node);
+            // Аргументы вычисляются раньше объекта, как в дереве
+            for (auto& arg : call.GetArgs()) {
+                Emit(arg);
+            }
+            Emit(call.GetObject());
+            const auto site = static_cast<uint32_t>(code_.call_sites_.size());
+            code_.call_sites_.push_back({call.GetMethodId(), {}});
+            Emit(Op::CALL_METHOD, site, Count(call.GetArgs().size()));
+        } else if (type == typeid(Assignment)) {
+            auto& assignment = static_cast<Assignment&>(node);
+            Emit(assignment.GetValue());
+            Emit(Op::STORE_LOCAL, Slot(assignment.GetName()));
+        } else if (type == typeid(FieldAssignment)) {
+            auto& assignment = static_cast<FieldAssignment&>(node);
+            EmitVariable(assignment.GetObject());
+            Emit(Op::FIELD_TARGET);
+            Emit(assignment.GetValue());
+            Emit(Op::STORE_FIELD, Field(assignment.GetFieldName()));
+        } else if (type == typeid(Compound)) {
+            for (auto& child : static_cast<Compound&>(node).GetStatements()) {
+                Emit(child);
+                Emit(Op::POP);
+            }
+            Emit(Op::NONE);
+        } else if (type == typeid(Add)) {
+            EmitBinary(static_cast<BinaryOperation&>(node), Op::ADD);
+        } else if (type == typeid(Sub)) {
+            EmitBinary(static_cast<BinaryOperation&>(node), Op::SUB);
+        } else if (type == typeid(Mult)) {
+            EmitBinary(static_cast<BinaryOperation&>(node), Op::MULT);
+        } else if (type == typeid(Div)) {
+            EmitBinary(static_cast<BinaryOperation&>(node), Op::DIV);
+        } else if (type == typeid(Or)) {
+            EmitLogical(static_cast<BinaryOperation&>(node), Op::OR_JUMP, Op::OR_END);
+        } else if (type == typeid(And)) {
+            EmitLogical(static_cast<BinaryOperation&>(node), Op::AND_JUMP, Op::AND_END);
+        } else if (type == typeid(Comparison)) {
+            auto& comparison = static_cast<Comparison&>(node);
+            const auto index = static_cast<uint32_t>(code_.comparators_.size());
+            const Comparison::Kind kind = comparison.GetKind();
+            code_.comparators_.push_back(comparison.GetComparator());
+            EmitBinary(comparison, Op::COMPARE, index);
+            code_.code_.back().count = static_cast<uint16_t>(kind);
+        } else if (type == typeid(Not)) {
+            EmitUnary(static_cast<UnaryOperation&>(node), Op::NOT);
+        } else if (type == typeid(Negate)) {
+            EmitUnary(static_cast<UnaryOperation&>(node), Op::NEGATE);
+        } else if (type == typeid(Stringify)) {
+            EmitUnary(static_cast<UnaryOperation&>(node), Op::STRINGIFY);
+        } else if (type == typeid(IfElse)) {
+            EmitIfElse(static_cast<IfElse&>(node));
+        } else if (type == typeid(Return)) {
+            Emit(static_cast<Return&>(node).GetStatement());
+            Emit(Op::LEAVE);
+        } else if (type == typeid(Print)) {
+            EmitPrint(static_cast<Print&>(node));
+        } else if (type == typeid(NewInstance)) {
+            EmitNewInstance(static_cast<NewInstance&>(node));
+        } else if (type == typeid(None)) {
+            Emit(Op::NONE);
+        } else if (type == typeid(ClassDefinition)) {
+            needs_closure_ = true;
+            Emit(Op::CLASS_DEFINITION, Constant(static_cast<ClassDefinition&>(node).GetClass()));
+        } else {
+            const auto index = static_cast<uint32_t>(code_.opaque_.size());
+            code_.opaque_.push_back(std::move(statement));
+            needs_closure_ = true;
+            Emit(Op::OPAQUE, index);
+        }
+    }
+
+    uint32_t Emit(Op op, uint32_t arg = 0, uint16_t count = 0) {
+        code_.code_.push_back({op, count, arg});
+        return static_cast<uint32_t>(code_.code_.size() - 1);
+    }
+
+    // Адрес следующей инструкции
+    uint32_t Here() const {
+        return static_cast<uint32_t>(code_.code_.size());
+    }
+
+    static uint16_t Count(size_t count) {
+        if (count > UINT16_MAX) {
+            throw runtime_error("Too many arguments"s);
+        }
+        return static_cast<uint16_t>(count);
+    }
+
+    uint32_t Name(const string& name) {
+        auto [it, inserted] = names_.try_emplace(name, static_cast<uint32_t>(code_.names_.size()));
+        if (inserted) {
+            code_.names_.push_back(name);
+        }
+        return it->second;
+    }
+
+    uint32_t Field(const string& name) {
+        code_.field_sites_.push_back({Name(name), {}});
+        return static_cast<uint32_t>(code_.field_sites_.size() - 1);
+    }
+
+    uint32_t Constant(ObjectHolder object) {
+        code_.constants_.push_back(std::move(object));
+        return static_cast<uint32_t>(code_.constants_.size() - 1);
+    }
+
+    void EmitVariable(const VariableValue& variable) {
+        const auto& ids = variable.GetDottedIds();
+        if (ids.size() <= 1) {
+            Emit(Op::LOAD_LOCAL, Slot(variable.GetName()));
+            return;
+        }
+        Emit(Op::LOAD_LOCAL, Slot(ids.front()));
+        for (size_t i = 1; i + 1 < ids.size(); ++i) {
+            Emit(Op::GET_FIELD, Field(ids[i]));
+        }
+        Emit(Op::LOAD_FIELD, Field(ids.back()));
+    }
+
+    template <typename T>
+    void EmitConstant(ValueStatement<T>& constant) {
+        Emit(Op::CONST, Constant(constant.GetHolder()));
+    }
+
+    void EmitUnary(UnaryOperation& operation, Op op) {
+        Emit(operation.GetArgument());
+        Emit(op);
+    }
+
+    void EmitBinary(BinaryOperation& operation, Op op, uint32_t arg = 0) {
+        Emit(operation.GetLhs());
+        Emit(operation.GetRhs());
+        Emit(op, arg);
+    }
+
+    // Правый операнд пропускается переходом, если результат ясен по левому
+    void EmitLogical(BinaryOperation& operation, Op jump, Op end) {
+        Emit(operation.GetLhs());
+        const uint32_t skip = Emit(jump);
+        Emit(operation.GetRhs());
+        Emit(end);
+        code_.code_[skip].arg = Here();
+    }
+
+    void EmitIfElse(IfElse& if_else) {
+        Emit(if_else.GetCondition());
+        const uint32_t to_else = Emit(Op::JUMP_IF_FALSE);
+        Emit(if_else.GetIfBody());
+        const uint32_t to_end = Emit(Op::JUMP);
+        code_.code_[to_else].arg = Here();
+        Emit(if_else.GetElseBody());
+        code_.code_[to_end].arg = Here();
+    }
+
+    void EmitPrint(Print& print) {
+        if (!print.GetName().empty()) {
+            needs_closure_ = true;
+            Emit(Op::PRINT_NAME, Name(print.GetName()));
+            return;
+        }
+        // Как и в дереве, значение и следующий за ним пробел выводятся
+        // до вычисления следующего значения
+        if (auto* args = get_if<vector<unique_ptr<Statement>>>(&print.GetArguments())) {
+            for (size_t i = 0; i < args->size(); ++i) {
+                Emit((*args)[i]);
+                Emit(Op::PRINT_VALUE, 0, i + 1 < args->size() ? 1 : 0);
+            }
+        } else if (auto& argument = get<unique_ptr<Statement>>(print.GetArguments())) {
+            Emit(argument);
+            Emit(Op::PRINT_VALUE);
+        }
+        Emit(Op::PRINT_LINE);
+    }
+
+    void EmitNewInstance(NewInstance& instance) {
+        const auto index = static_cast<uint32_t>(code_.constructions_.size());
+        code_.constructions_.push_back({&instance.GetClass(), 0, {}, nullptr});
+        const uint16_t count = Count(instance.GetArgs().size());
+        Emit(Op::NEW_INSTANCE, index, count);
+        for (auto& arg : instance.GetArgs()) {
+            Emit(arg);
+        }
+        Emit(Op::INIT, index, count);
+        code_.constructions_[index].after_init = Here();
+    }
+
+    // Номер ячейки кадра для переменной name. Если кадр не понадобится,
+    // Build заменит обращения к ячейкам поиском по имени
+    uint32_t Slot(const string& name) {
+        auto [it, inserted] = slots_.try_emplace(name, static_cast<uint32_t>(slot_names_.size()));
+        if (inserted) {
+            slot_names_.push_back(Name(name));
+        }
+        return it->second;
+    }
+
+    Bytecode& code_;
+    unordered_map<string, uint32_t> names_;
+    bool method_ = false;
+    unordered_map<string, uint32_t> slots_;
+    // Имя (индекс в names_) переменной каждой ячейки
+    vector<uint32_t> slot_names_;
+    // Тело содержит инструкции, которым нужен Closure, и кадр не используется
+    bool needs_closure_ = false;
+};
+
+/*
+Исполняет байт-код. Стек операндов, ячейки кадров и стек кадров общие для всех машин
+потока: вызов, который байт-код не выполняет сам (например, __str__ при выводе),
+запускает вложенную машину поверх тех же стеков, и она по завершении возвращает их
+к прежнему размеру. Поэтому ссылки на элементы стеков не живут дольше одной инструкции,
+а значения, передаваемые в runtime, предварительно снимаются со стека.
+
+return завершает кадр, и его значение получает вызвавший кадр. Вне тела метода
+return, как и в дереве, завершает выполнение кода. Ошибка выполнения передаётся дальше
+исключением, а деструктор машины снимает все её кадры
+*/
+class Bytecode::Machine {
+public:
+    Machine(Closure& closure, Context& context)
+        : stacks_(ThreadStacks())
+        , operands_(stacks_.operands)
+        , locals_(stacks_.locals)
+        , frames_(stacks_.frames)
+        , operands_base_(operands_.size())
+        , locals_base_(locals_.size())
+        , frames_base_(frames_.size())
+        , closure_(closure)
+        , context_(context) {
+    }
+
+    Machine(const Machine&) = delete;
+    Machine& operator=(const Machine&) = delete;
+
+    ~Machine() {
+        frames_.resize(frames_base_);
+        locals_.resize(locals_base_);
+        operands_.resize(operands_base_);
+    }
+
+    // Выполняет код, переменные которого ищутся в closure
+    ObjectHolder Run(const Bytecode& code) {
+        frames_.push_back({&code, 0, locals_.size(), operands_.size(), false});
+        return Loop();
+    }
+
+    // Выполняет тело метода с кадром
+    ObjectHolder RunMethod(const Bytecode& code, const ObjectHolder& self,
+                           const vector<ObjectHolder>& actual_args) {
+        const size_t locals = locals_.size();
+        locals_.resize(locals + code.frame_size_);
+        locals_[locals] = self;
+        for (size_t i = 0; i < actual_args.size(); ++i) {
+            locals_[locals + code.param_slots_[i]] = actual_args[i];
+        }
+        frames_.push_back({&code, 0, locals, operands_.size(), false});
+        return Loop();
+    }
+
+private:
+    struct Frame {
+        const Bytecode* code;
+        uint32_t pc;
+        // Начало ячеек кадра и стека операндов кадра
+        size_t locals;
+        size_t operands;
+        // Кадр __init__: результат метода отбрасывается, на стеке остаётся созданный объект
+        bool constructor;
+    };
+
+    struct Stacks {
+        vector<ObjectHolder> operands;
+        vector<Slot> locals;
+        vector<Frame> frames;
+    };
+
+    static Stacks& ThreadStacks() {
+        thread_local Stacks stacks;
+        return stacks;
+    }
+
+    ObjectHolder Loop() {
+        Load();
+        return Dispatch();
+    }
+
+    ObjectHolder Dispatch() {
+        for (;;) {
+            const Instruction instruction = code_[pc_++];
+            switch (instruction.op) {
+                case Op::CONST:
+                    operands_.push_back(bytecode_->constants_[instruction.arg]);
+                    break;
+                case Op::NONE:
+                    operands_.emplace_back();
+                    break;
+                case Op::LOAD_LOCAL: {
+                    const Slot& slot = locals_[locals_start_ + instruction.arg];
+                    if (!slot) {
+                        ThrowUndefinedVariable();
+                    }
+                    operands_.push_back(*slot);
+                    break;
+                }
+                case Op::STORE_LOCAL:
+                    locals_[locals_start_ + instruction.arg] = operands_.back();
+                    break;
+                case Op::LOAD_NAME:
+                    operands_.push_back(LookUp(closure_, Name(instruction)));
+                    break;
+                case Op::STORE_NAME:
+                    closure_[Name(instruction)] = operands_.back();
+                    break;
+                case Op::GET_FIELD: {
+                    ObjectHolder& top = operands_.back();
+                    FieldSite& site = bytecode_->field_sites_[instruction.arg];
+                    runtime::FieldTable& fields = AsInstance(top, "VariableValue fail").Fields();
+                    top = ObjectHolder(site.cache.Insert(fields, bytecode_->names_[site.name]));
+                    break;
+                }
+                case Op::LOAD_FIELD: {
+                    ObjectHolder& top = operands_.back();
+                    FieldSite& site = bytecode_->field_sites_[instruction.arg];
+                    runtime::FieldTable& fields = AsInstance(top, "VariableValue fail").Fields();
+                    const ObjectHolder* field =
+                        site.cache.Find(fields, bytecode_->names_[site.name]);
+                    if (field == nullptr) {
+                        ThrowUndefinedVariable();
+                    }
+                    top = ObjectHolder(*field);
+                    break;
+                }
+                case Op::FIELD_TARGET:
+                    AsInstance(operands_.back(), "FieldAssignment fail");
+                    break;
+                case Op::STORE_FIELD:
+                    StoreField(instruction);
+                    break;
+                case Op::PRINT_VALUE:
+                case Op::PRINT_LINE:
+                case Op::PRINT_NAME:
+                    Print(instruction);
+                    break;
+                case Op::CALL_METHOD:
+                    CallMethod(instruction);
+                    break;
+                case Op::NEW_INSTANCE:
+                    NewInstance(instruction);
+                    break;
+                case Op::INIT:
+                    Init(instruction);
+                    break;
+                case Op::STRINGIFY:
+                    ApplyUnary(Stringify::Apply);
+                    break;
+                case Op::ADD:
+                case Op::SUB:
+                case Op::MULT:
+                case Op::DIV:
+                    Arithmetic(instruction.op);
+                    break;
+                case Op::NOT:
+                    ApplyUnary(Not::Apply);
+                    break;
+                case Op::NEGATE:
+                    ApplyUnary(Negate::Apply);
+                    break;
+                case Op::COMPARE:
+                    Compare(instruction);
+                    break;
+                case Op::OR_JUMP: {
+                    ObjectHolder& lhs = operands_.back();
+                    auto* value = lhs.TryAs<runtime::Bool>();
+                    if (value != nullptr && value->GetValue()) {
+                        lhs = ObjectHolder::Own(runtime::Bool(true));
+                        pc_ = instruction.arg;
+                    } else {
+                        operands_.pop_back();
+                    }
+                    break;
+                }
+                case Op::OR_END:
+                    OrEnd();
+                    break;
+                case Op::AND_JUMP: {
+                    ObjectHolder& lhs = operands_.back();
+                    auto* value = lhs.TryAs<runtime::Bool>();
+                    if (value != nullptr && !value->GetValue()) {
+                        lhs = ObjectHolder::Own(runtime::Bool(false));
+                        pc_ = instruction.arg;
+                    }
+                    break;
+                }
+                case Op::AND_END:
+                    AndEnd();
+                    break;
+                case Op::JUMP:
+                    pc_ = instruction.arg;
+                    break;
+                case Op::JUMP_IF_FALSE: {
+                    auto* value = operands_.back().TryAs<runtime::Bool>();
+                    if (value == nullptr) {
+                        throw runtime_error("IfElse fail"s);
+                    }
+                    const bool condition = value->GetValue();
+                    operands_.pop_back();
+                    if (!condition) {
+                        pc_ = instruction.arg;
+                    }
+                    break;
+                }
+                case Op::POP:
+                    operands_.pop_back();
+                    break;
+                case Op::LEAVE: {
+                    ObjectHolder result = Pop();
+                    // self внутри метода может быть невладеющей ссылкой
+                    result.Retain();
+                    if (Leave(result)) {
+                        return result;
+                    }
+                    break;
+                }
+                case Op::CLASS_DEFINITION: {
+                    const ObjectHolder& cls = bytecode_->constants_[instruction.arg];
+                    closure_[cls.TryAs<runtime::Class>()->GetName()] = cls;
+                    operands_.push_back(cls);
+                    break;
+                }
+                case Op::OPAQUE:
+                    Opaque(instruction);
+                    break;
+            }
+        }
+    }
+
+    // Делает текущим верхний кадр
+    void Load() {
+        const Frame& frame = frames_.back();
+        bytecode_ = frame.code;
+        code_ = frame.code->code_.data();
+        pc_ = frame.pc;
+        locals_start_ = frame.locals;
+    }
+
+    const string& Name(const Instruction& instruction) const {
+        return bytecode_->names_[instruction.arg];
+    }
+
+    ObjectHolder Pop() {
+        ObjectHolder value = std::move(operands_.back());
+        operands_.pop_back();
+        return value;
+    }
+
+    // Снимает верхний кадр. Возвращает true, если это был первый кадр этой машины
+    // и её выполнение закончено. Иначе кладёт result на стек вызвавшего кадра
+    bool Leave(ObjectHolder& result) {
+        const Frame frame = frames_.back();
+        frames_.pop_back();
+        locals_.resize(frame.locals);
+        operands_.resize(frame.operands);
+        if (frames_.size() == frames_base_) {
+            return true;
+        }
+        if (!frame.constructor) {
+            operands_.push_back(std::move(result));
+        }
+        Load();
+        return false;
+    }
+
+    // Если тело метода выполняется байт-кодом с кадром, возвращает этот байт-код
+    static const Bytecode* Inlinable(const Statement& body) {
+        if (typeid(body) != typeid(Bytecode)) {
+            return nullptr;
+        }
+        const auto& code = static_cast<const Bytecode&>(body);
+        return code.frame_size_ != 0 ? &code : nullptr;
+    }
+
+    // Кладёт кадр метода callee. Его аргументы - count верхних значений стека
+    void Enter(const Bytecode& callee, ObjectHolder self, size_t count, bool constructor) {
+        frames_.back().pc = pc_;
+        const size_t locals = locals_.size();
+        locals_.resize(locals + callee.frame_size_);
+        locals_[locals] = std::move(self);
+        const size_t args = operands_.size() - count;
+        for (size_t i = 0; i < count; ++i) {
+            locals_[locals + callee.param_slots_[i]] = std::move(operands_[args + i]);
+        }
+        operands_.resize(args);
+        frames_.push_back({&callee, 0, locals, args, constructor});
+        Load();
+    }
+
+    // Снимает со стека count аргументов вызова
+    vector<ObjectHolder> PopArgs(size_t count) {
+        const auto first = operands_.end() - static_cast<ptrdiff_t>(count);
+        vector<ObjectHolder> args(make_move_iterator(first), make_move_iterator(operands_.end()));
+        operands_.erase(first, operands_.end());
+        return args;
+    }
+
+    MYTHON_NOINLINE void CallMethod(const Instruction& instruction) {
+        ObjectHolder object = Pop();
+        auto& instance = AsInstance(object, "MethodCall fail");
+        CallSite& site = bytecode_->call_sites_[instruction.arg];
+        const runtime::Method* method =
+            site.cache.Find(instance.GetClass(), site.method, instruction.count);
+        if (method == nullptr) {
+            throw runtime_error("Strange Method"s);
+        }
+        if (const Bytecode* callee = Inlinable(*method->body)) {
+            Enter(*callee, std::move(object), instruction.count, false);
+            return;
+        }
+        const vector<ObjectHolder> args = PopArgs(instruction.count);
+        operands_.push_back(method->body->ExecuteMethod(
+            method->formal_params, ObjectHolder::Share(instance), args, context_));
+    }
+
+    MYTHON_NOINLINE void NewInstance(const Instruction& instruction) {
+        Construction& construction = bytecode_->constructions_[instruction.arg];
+        operands_.push_back(ObjectHolder::Own(runtime::ClassInstance(*construction.cls)));
+        const runtime::Method* init =
+            construction.init_cache.Find(*construction.cls, runtime::INIT_METHOD_ID,
+                                         instruction.count);
+        construction.init = init;
+        if (init == nullptr) {
+            pc_ = construction.after_init;
+        }
+    }
+
+    // Под аргументами лежит объект, созданный NEW_INSTANCE. Он и остаётся на стеке
+    MYTHON_NOINLINE void Init(const Instruction& instruction) {
+        const ObjectHolder& object = operands_[operands_.size() - instruction.count - 1];
+        auto& instance = *object.TryAs<runtime::ClassInstance>();
+        const runtime::Method* method = bytecode_->constructions_[instruction.arg].init;
+        if (const Bytecode* callee = Inlinable(*method->body)) {
+            Enter(*callee, object, instruction.count, true);
+            return;
+        }
+        const vector<ObjectHolder> args = PopArgs(instruction.count);
+        method->body->ExecuteMethod(method->formal_params, ObjectHolder::Share(instance), args,
+                                    context_);
+    }
+
+    MYTHON_NOINLINE void StoreField(const Instruction& instruction) {
+        ObjectHolder value = Pop();
+        const ObjectHolder object = Pop();
+        FieldSite& site = bytecode_->field_sites_[instruction.arg];
+        site.cache.Insert(object.TryAs<runtime::ClassInstance>()->Fields(),
+                          bytecode_->names_[site.name]) = value;
+        operands_.push_back(std::move(value));
+    }
+
+    MYTHON_NOINLINE void Print(const Instruction& instruction) {
+        ostream& os = context_.GetOutputStream();
+        if (instruction.op == Op::PRINT_VALUE) {
+            // Вывод объекта может вызвать __str__ и изменить стек
+            PrintValue(Pop(), os, context_);
+            if (instruction.count != 0) {
+                os << " "sv;
+            }
+            return;
+        }
+        if (instruction.op == Op::PRINT_NAME) {
+            PrintValue(closure_[Name(instruction)], os, context_);
+        }
+        os << endl;
+        operands_.emplace_back();
+    }
+
+    template <typename Operation>
+    MYTHON_NOINLINE void ApplyUnary(Operation operation) {
+        const ObjectHolder arg = Pop();
+        if constexpr (is_invocable_v<Operation, const ObjectHolder&, Context&>) {
+            operands_.push_back(operation(arg, context_));
+        } else {
+            operands_.push_back(operation(arg));
+        }
+    }
+
+    // Операции над двумя числами выполняются на месте, остальные - через Apply дерева
+    MYTHON_NOINLINE void Arithmetic(Op op) {
+        const size_t size = operands_.size();
+        auto* lhs_number = operands_[size - 2].TryAs<runtime::Number>();
+        auto* rhs_number = operands_[size - 1].TryAs<runtime::Number>();
+        if (lhs_number != nullptr && rhs_number != nullptr
+            && (op != Op::DIV || rhs_number->GetValue() != 0)) {
+            const int lhs = lhs_number->GetValue();
+            const int rhs = rhs_number->GetValue();
+            const int result = op == Op::ADD   ? lhs + rhs
+                               : op == Op::SUB  ? lhs - rhs
+                               : op == Op::MULT ? lhs * rhs
+                                                : lhs / rhs;
+            operands_.pop_back();
+            operands_.back() = ObjectHolder::Own(runtime::Number(result));
+            return;
+        }
+        const ObjectHolder rhs = Pop();
+        const ObjectHolder lhs = Pop();
+        switch (op) {
+            case Op::ADD:
+                operands_.push_back(Add::Apply(lhs, rhs, context_));
+                break;
+            case Op::SUB:
+                operands_.push_back(Sub::Apply(lhs, rhs, context_));
+                break;
+            case Op::MULT:
+                operands_.push_back(Mult::Apply(lhs, rhs, context_));
+                break;
+            default:
+                operands_.push_back(Div::Apply(lhs, rhs, context_));
+                break;
+        }
+    }
+
+    MYTHON_NOINLINE void Compare(const Instruction& instruction) {
+        const auto kind = static_cast<Comparison::Kind>(instruction.count);
+        const size_t size = operands_.size();
+        auto* lhs_number = operands_[size - 2].TryAs<runtime::Number>();
+        auto* rhs_number = operands_[size - 1].TryAs<runtime::Number>();
+        if (kind != Comparison::Kind::UNKNOWN && lhs_number != nullptr && rhs_number != nullptr) {
+            const bool result =
+                Comparison::Compare(kind, lhs_number->GetValue(), rhs_number->GetValue());
+            operands_.pop_back();
+            operands_.back() = ObjectHolder::Own(runtime::Bool(result));
+            return;
+        }
+        const ObjectHolder rhs = Pop();
+        const ObjectHolder lhs = Pop();
+        const bool result = bytecode_->comparators_[instruction.arg](lhs, rhs, context_);
+        operands_.push_back(ObjectHolder::Own(runtime::Bool(result)));
+    }
+
+    MYTHON_NOINLINE void OrEnd() {
+        ObjectHolder& rhs = operands_.back();
+        auto* value = rhs.TryAs<runtime::Bool>();
+        if (value == nullptr) {
+            throw runtime_error("Or method fail"s);
+        }
+        rhs = ObjectHolder::Own(runtime::Bool(value->GetValue()));
+    }
+
+    MYTHON_NOINLINE void AndEnd() {
+        const ObjectHolder rhs = Pop();
+        ObjectHolder& lhs = operands_.back();
+        auto* value = rhs.TryAs<runtime::Bool>();
+        if (value == nullptr || lhs.TryAs<runtime::Bool>() == nullptr) {
+            throw runtime_error("And method fail"s);
+        }
+        lhs = ObjectHolder::Own(runtime::Bool(value->GetValue()));
+    }
+
+    MYTHON_NOINLINE void Opaque(const Instruction& instruction) {
+        operands_.push_back(bytecode_->opaque_[instruction.arg]->Execute(closure_, context_));
+    }
+
+    Stacks& stacks_;
+    vector<ObjectHolder>& operands_;
+    vector<Slot>& locals_;
+    vector<Frame>& frames_;
+    const size_t operands_base_;
+    const size_t locals_base_;
+    const size_t frames_base_;
+    Closure& closure_;
+    Context& context_;
+
+    // Текущий кадр
+    const Bytecode* bytecode_ = nullptr;
+    const Instruction* code_ = nullptr;
+    uint32_t pc_ = 0;
+    size_t locals_start_ = 0;
+};
+
+ObjectHolder Bytecode::Execute(Closure& closure, Context& context) {
+    return Machine{closure, context}.Run(*this);
+}
+
+ObjectHolder Bytecode::ExecuteMethod(const vector<string>& formal_params,
+                                     const ObjectHolder& self,
+                                     const vector<ObjectHolder>& actual_args,
+                                     Context& context) {
+    if (frame_size_ == 0) {
+        return Executable::ExecuteMethod(formal_params, self, actual_args, context);
+    }
+    Closure unused;
+    return Machine{unused, context}.RunMethod(*this, self, actual_args);
+}
+
+size_t Bytecode::FrameSize() const {
+    return frame_size_;
+}
+
+size_t Bytecode::Size() const {
+    return code_.size();
+}
+
+size_t Bytecode::CacheHits() const {
+    size_t hits = 0;
+    for (const auto& site : call_sites_) {
+        hits += site.cache.Hits();
+    }
+    for (const auto& construction : constructions_) {
+        hits += construction.init_cache.Hits();
+    }
+    return hits;
+}
+
+size_t Bytecode::CacheMisses() const {
+    size_t misses = 0;
+    for (const auto& site : call_sites_) {
+        misses += site.cache.Misses();
+    }
+    for (const auto& construction : constructions_) {
+        misses += construction.init_cache.Misses();
+    }
+    return misses;
+}
+
+unique_ptr<Bytecode> Compile(unique_ptr<Statement> statement) {
+    auto code = make_unique<Bytecode>();
+    BytecodeCompiler{*code}.Build(statement);
+    return code;
+}
+
+unique_ptr<Bytecode> CompileMethod(unique_ptr<Statement> body,
+                                   const vector<string>& formal_params) {
+    auto code = make_unique<Bytecode>();
+    BytecodeCompiler{*code, formal_params}.Build(body);
+    return code;
+}
+
+}  // namespace ast
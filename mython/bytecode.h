@@ -0,0 +1,151 @@
+#pragma once
+
+#include "statement.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ast {
+
+/*
+Байт-код для стековой виртуальной машины.
+Каждое выражение оставляет на стеке операндов ровно одно значение, инструкции берут
+аргументы с вершины стека. Ветвления и логические операции компилируются в переходы,
+поэтому выполнение - один цикл по массиву инструкций без рекурсии.
+
+Вызов метода, тело которого тоже скомпилировано в байт-код с кадром, не вызывает
+ClassInstance::Call: машина кладёт новый кадр в свой стек кадров и продолжает цикл.
+Локальные переменные кадра лежат в ячейках общего стека машины, а не в Closure.
+Остальные методы и инструкции, которых байт-код не знает, выполняются через
+ExecuteMethod и Execute, как в дереве
+*/
+class Bytecode : public Statement {
+public:
+    // Выполняет код. Результат и вывод совпадают с исходным деревом
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    runtime::ObjectHolder ExecuteMethod(const std::vector<std::string>& formal_params,
+                                       const runtime::ObjectHolder& self,
+                                       const std::vector<runtime::ObjectHolder>& actual_args,
+                                       runtime::Context& context) override;
+
+    // Возвращает число ячеек в кадре метода либо 0, если переменные ищутся по имени
+    [[nodiscard]] size_t FrameSize() const;
+
+    // Возвращает число инструкций
+    [[nodiscard]] size_t Size() const;
+
+    // Суммы попаданий и промахов встроенных кэшей всех вызовов методов и конструкторов
+    [[nodiscard]] size_t CacheHits() const;
+    [[nodiscard]] size_t CacheMisses() const;
+
+private:
+    friend class BytecodeCompiler;
+
+    enum class Op : std::uint8_t {
+        CONST,
+        NONE,
+        LOAD_LOCAL,
+        STORE_LOCAL,
+        LOAD_NAME,
+        STORE_NAME,
+        // Промежуточное поле в цепочке a.b.c: отсутствующее поле создаётся со значением None
+        GET_FIELD,
+        LOAD_FIELD,
+        // Проверяет, что на вершине стека объект, полю которого присваивается значение
+        FIELD_TARGET,
+        STORE_FIELD,
+        // Выводит значение с вершины стека, при count != 0 - и пробел после него
+        PRINT_VALUE,
+        PRINT_LINE,
+        PRINT_NAME,
+        CALL_METHOD,
+        NEW_INSTANCE,
+        INIT,
+        STRINGIFY,
+        ADD,
+        SUB,
+        MULT,
+        DIV,
+        NOT,
+        NEGATE,
+        COMPARE,
+        OR_JUMP,
+        OR_END,
+        AND_JUMP,
+        AND_END,
+        JUMP,
+        JUMP_IF_FALSE,
+        POP,
+        // Завершает кадр со значением с вершины стека: return и конец кода
+        LEAVE,
+        CLASS_DEFINITION,
+        OPAQUE,
+    };
+
+    // Смысл arg зависит от op: индекс в одной из таблиц ниже (для CALL_METHOD - в call_sites_,
+    // для NEW_INSTANCE и INIT - в constructions_, для операций с полями - в field_sites_),
+    // номер ячейки кадра
+    // либо адрес перехода. count - число аргументов вызова либо вид сравнения
+    struct Instruction {
+        Op op;
+        std::uint16_t count = 0;
+        std::uint32_t arg = 0;
+    };
+
+    // Создание объекта: если у класса нет подходящего __init__,
+    // аргументы не вычисляются и выполнение продолжается с after_init.
+    // NEW_INSTANCE находит __init__ через кэш и оставляет его в init для INIT
+    struct Construction {
+        const runtime::Class* cls;
+        std::uint32_t after_init = 0;
+        runtime::MethodCache init_cache;
+        const runtime::Method* init = nullptr;
+    };
+
+    // Место вызова метода со своим встроенным кэшем
+    struct CallSite {
+        runtime::MethodId method;
+        runtime::MethodCache cache;
+    };
+
+    // Обращение к полю объекта со своим встроенным кэшем форм
+    struct FieldSite {
+        std::uint32_t name;
+        runtime::FieldCache cache;
+    };
+
+    class Machine;
+
+    // Ячейка кадра. Пустой optional - переменная ещё не присвоена
+    using Slot = std::optional<runtime::ObjectHolder>;
+
+    std::vector<Instruction> code_;
+    std::vector<std::string> names_;
+    // Константы и объявленные классы
+    std::vector<runtime::ObjectHolder> constants_;
+    // Кэши заполняются при выполнении
+    mutable std::vector<Construction> constructions_;
+    mutable std::vector<CallSite> call_sites_;
+    mutable std::vector<FieldSite> field_sites_;
+    std::vector<Comparison::Comparator> comparators_;
+    std::vector<std::unique_ptr<Statement>> opaque_;
+    std::uint32_t frame_size_ = 0;
+    // Ячейки, в которые попадают self (всегда 0) и параметры метода
+    std::vector<std::uint32_t> param_slots_;
+    // Код - тело метода: return завершает его
+    bool method_ = false;
+};
+
+// Компилирует дерево statement в байт-код. Узлы дерева при этом разбираются
+std::unique_ptr<Bytecode> Compile(std::unique_ptr<Statement> statement);
+
+// Компилирует тело метода с параметрами formal_params
+// и назначает его локальным переменным ячейки кадра
+std::unique_ptr<Bytecode> CompileMethod(std::unique_ptr<Statement> body,
+                                        const std::vector<std::string>& formal_params);
+
+}  // namespace ast
@@ -0,0 +1,723 @@
+#include "cache.h"
+
+#include "bytecode.h"
+#include "lexer.h"
+#include "linear.h"
+#include "optimize.h"
+#include "statement.h"
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <typeinfo>
+#include <unordered_map>
+
+using namespace std;
+
+namespace ast {
+
+using runtime::ObjectHolder;
+
+namespace {
+
+constexpr string_view MAGIC = "MYTHONPC"sv;
+// Меняется при любом изменении формата: файлы других версий разбираются заново
+constexpr uint32_t FORMAT_VERSION = 1;
+constexpr uint32_t NO_CLASS = UINT32_MAX;
+
+enum class Tag : uint8_t {
+    // Отсутствующий потомок (например, ветка else)
+    EMPTY,
+    NUMBER,
+    STRING,
+    BOOL,
+    NONE,
+    VARIABLE,
+    ASSIGNMENT,
+    FIELD_ASSIGNMENT,
+    PRINT_VARIABLE,
+    PRINT_ONE,
+    PRINT_LIST,
+    METHOD_CALL,
+    NEW_INSTANCE,
+    STRINGIFY,
+    ADD,
+    SUB,
+    MULT,
+    DIV,
+    OR,
+    AND,
+    NOT,
+    NEGATE,
+    COMPARISON,
+    COMPOUND,
+    METHOD_BODY,
+    RETURN,
+    CLASS_DEFINITION,
+    IF_ELSE,
+};
+
+using Comparator = bool (*)(const ObjectHolder&, const ObjectHolder&, runtime::Context&);
+
+// Сравнения, которые создаёт парсер. В файле хранится номер сравнения в этом списке
+const array<Comparator, 6> COMPARATORS = {runtime::Equal,   runtime::NotEqual,
+                                          runtime::Less,    runtime::Greater,
+                                          runtime::LessOrEqual, runtime::GreaterOrEqual};
+
+// Целые числа записываются в LEB128: по 7 бит в байте, начиная с младших.
+// Номера строк, длины и счётчики обычно малы и занимают один байт.
+// U64 записывает 8 байт в порядке little-endian независимо от платформы
+class Output {
+public:
+    void U8(uint8_t value) {
+        data_.push_back(static_cast<char>(value));
+    }
+
+    void Uint(uint32_t value) {
+        while (value >= 0x80) {
+            U8(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        U8(static_cast<uint8_t>(value));
+    }
+
+    // Отрицательные числа чередуются с положительными, чтобы малые по модулю были короткими
+    void Int(int32_t value) {
+        const auto bits = static_cast<uint32_t>(value);
+        Uint((bits << 1) ^ (value < 0 ? UINT32_MAX : 0));
+    }
+
+    void U64(uint64_t value) {
+        for (int shift = 0; shift < 64; shift += 8) {
+            U8(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    void Bytes(string_view bytes) {
+        data_.append(bytes);
+    }
+
+    string& Data() {
+        return data_;
+    }
+
+private:
+    string data_;
+};
+
+class Input {
+public:
+    explicit Input(string_view data)
+        : data_(data) {
+    }
+
+    uint8_t U8() {
+        return static_cast<uint8_t>(Bytes(1)[0]);
+    }
+
+    uint32_t Uint() {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            const uint8_t byte = U8();
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw CacheError("Invalid number in program cache"s);
+    }
+
+    int32_t Int() {
+        const uint32_t bits = Uint();
+        return static_cast<int32_t>((bits >> 1) ^ (0 - (bits & 1)));
+    }
+
+    uint64_t U64() {
+        const string_view bytes = Bytes(8);
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; --i) {
+            value = (value << 8) | static_cast<uint8_t>(bytes[i]);
+        }
+        return value;
+    }
+
+    string_view Bytes(size_t size) {
+        if (size > data_.size() - pos_) {
+            throw CacheError("Program cache is truncated"s);
+        }
+        const string_view result = data_.substr(pos_, size);
+        pos_ += size;
+        return result;
+    }
+
+    // Сколько байт осталось прочитать
+    [[nodiscard]] size_t Remaining() const {
+        return data_.size() - pos_;
+    }
+
+private:
+    string_view data_;
+    size_t pos_ = 0;
+};
+
+// FNV-1a
+uint64_t HashSource(string_view source) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : source) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Начало файла кэша: хеш и длина исходного текста, по которому он построен
+string CacheKey(string_view source) {
+    Output key;
+    key.U64(HashSource(source));
+    key.U64(source.size());
+    return std::move(key.Data());
+}
+
+}  // namespace
+
+/*
+Формат:
+  сигнатура, версия, число свёрнутых узлов
+  таблица строк: число строк, затем длина и байты каждой
+  классы: число классов, имена, затем для каждого класса номер родителя и методы
+  (имя, параметры, тело)
+  тело программы
+Узел - тег и операнды, потомки записываются сразу за родителем.
+Родитель класса всегда имеет меньший номер, чем сам класс
+*/
+class ProgramWriter {
+public:
+    string Write(const Program& program) {
+        Output body;
+        WriteNode(body, program.GetBody());
+
+        // Тела методов могут ссылаться на классы, ещё не попавшие в таблицу
+        vector<string> records;
+        for (size_t i = 0; i < classes_.size(); ++i) {
+            const runtime::Class* cls = classes_[i];
+            Output record;
+            WriteClass(record, *cls);
+            records.push_back(std::move(record.Data()));
+        }
+
+        Output out;
+        out.Bytes(MAGIC);
+        out.Uint(FORMAT_VERSION);
+        out.U64(program.FoldedNodes());
+        out.Uint(static_cast<uint32_t>(strings_.size()));
+        for (const string& str : strings_) {
+            out.Uint(static_cast<uint32_t>(str.size()));
+            out.Bytes(str);
+        }
+        out.Uint(static_cast<uint32_t>(classes_.size()));
+        for (const runtime::Class* cls : classes_) {
+            out.Uint(string_indices_.at(cls->GetName()));
+        }
+        for (const string& record : records) {
+            out.Bytes(record);
+        }
+        out.Bytes(body.Data());
+        return std::move(out.Data());
+    }
+
+private:
+    void WriteNode(Output& out, const unique_ptr<Statement>& statement) {
+        if (!statement) {
+            out.U8(static_cast<uint8_t>(Tag::EMPTY));
+            return;
+        }
+        const Statement& node = *statement;
+        const type_info& type = typeid(node);
+
+        if (type == typeid(NumericConst)) {
+            WriteTag(out, Tag::NUMBER);
+            out.Int(static_cast<const NumericConst&>(node).GetConstant().GetValue());
+        } else if (type == typeid(StringConst)) {
+            WriteTag(out, Tag::STRING);
+            out.Uint(String(static_cast<const StringConst&>(node).GetConstant().GetValue()));
+        } else if (type == typeid(BoolConst)) {
+            WriteTag(out, Tag::BOOL);
+            out.U8(static_cast<const BoolConst&>(node).GetConstant().GetValue() ? 1 : 0);
+        } else if (type == typeid(None)) {
+            WriteTag(out, Tag::NONE);
+        } else if (type == typeid(VariableValue)) {
+            WriteTag(out, Tag::VARIABLE);
+            WriteVariable(out, static_cast<const VariableValue&>(node));
+        } else if (type == typeid(Assignment)) {
+            const auto& assignment = static_cast<const Assignment&>(node);
+            WriteTag(out, Tag::ASSIGNMENT);
+            out.Uint(String(assignment.GetName()));
+            WriteNode(out, assignment.GetValue());
+        } else if (type == typeid(FieldAssignment)) {
+            const auto& assignment = static_cast<const FieldAssignment&>(node);
+            WriteTag(out, Tag::FIELD_ASSIGNMENT);
+            WriteVariable(out, assignment.GetObject());
+            out.Uint(String(assignment.GetFieldName()));
+            WriteNode(out, assignment.GetValue());
+        } else if (type == typeid(Print)) {
+            WritePrint(out, static_cast<const Print&>(node));
+        } else if (type == typeid(MethodCall)) {
+            const auto& call = static_cast<const MethodCall&>(node);
+            WriteTag(out, Tag::METHOD_CALL);
+            WriteNode(out, call.GetObject());
+            out.Uint(String(call.GetMethod()));
+            WriteList(out, call.GetArgs());
+        } else if (type == typeid(NewInstance)) {
+            const auto& instance = static_cast<const NewInstance&>(node);
+            WriteTag(out, Tag::NEW_INSTANCE);
+            out.Uint(ClassIndex(&instance.GetClass()));
+            WriteList(out, instance.GetArgs());
+        } else if (type == typeid(Stringify)) {
+            WriteUnary(out, Tag::STRINGIFY, node);
+        } else if (type == typeid(Not)) {
+            WriteUnary(out, Tag::NOT, node);
+        } else if (type == typeid(Negate)) {
+            WriteUnary(out, Tag::NEGATE, node);
+        } else if (type == typeid(Add)) {
+            WriteBinary(out, Tag::ADD, node);
+        } else if (type == typeid(Sub)) {
+            WriteBinary(out, Tag::SUB, node);
+        } else if (type == typeid(Mult)) {
+            WriteBinary(out, Tag::MULT, node);
+        } else if (type == typeid(Div)) {
+            WriteBinary(out, Tag::DIV, node);
+        } else if (type == typeid(Or)) {
+            WriteBinary(out, Tag::OR, node);
+        } else if (type == typeid(And)) {
+            WriteBinary(out, Tag::AND, node);
+        } else if (type == typeid(Comparison)) {
+            WriteTag(out, Tag::COMPARISON);
+            out.U8(ComparatorIndex(static_cast<const Comparison&>(node).GetComparator()));
+            WriteBinary(out, node);
+        } else if (type == typeid(Compound)) {
+            WriteTag(out, Tag::COMPOUND);
+            WriteList(out, static_cast<const Compound&>(node).GetStatements());
+        } else if (type == typeid(MethodBody)) {
+            WriteTag(out, Tag::METHOD_BODY);
+            WriteNode(out, static_cast<const MethodBody&>(node).GetBody());
+        } else if (type == typeid(Return)) {
+            WriteTag(out, Tag::RETURN);
+            WriteNode(out, static_cast<const Return&>(node).GetStatement());
+        } else if (type == typeid(ClassDefinition)) {
+            WriteTag(out, Tag::CLASS_DEFINITION);
+            const auto& cls = static_cast<const ClassDefinition&>(node).GetClass();
+            out.Uint(ClassIndex(cls.TryAs<runtime::Class>()));
+        } else if (type == typeid(IfElse)) {
+            const auto& if_else = static_cast<const IfElse&>(node);
+            WriteTag(out, Tag::IF_ELSE);
+            WriteNode(out, if_else.GetCondition());
+            WriteNode(out, if_else.GetIfBody());
+            WriteNode(out, if_else.GetElseBody());
+        } else {
+            throw runtime_error("Cannot serialize statement of type "s + type.name());
+        }
+    }
+
+    static void WriteTag(Output& out, Tag tag) {
+        out.U8(static_cast<uint8_t>(tag));
+    }
+
+    void WriteUnary(Output& out, Tag tag, const Statement& node) {
+        WriteTag(out, tag);
+        WriteNode(out, static_cast<const UnaryOperation&>(node).GetArgument());
+    }
+
+    void WriteBinary(Output& out, Tag tag, const Statement& node) {
+        WriteTag(out, tag);
+        WriteBinary(out, node);
+    }
+
+    void WriteBinary(Output& out, const Statement& node) {
+        const auto& operation = static_cast<const BinaryOperation&>(node);
+        WriteNode(out, operation.GetLhs());
+        WriteNode(out, operation.GetRhs());
+    }
+
+    void WriteList(Output& out, const vector<unique_ptr<Statement>>& statements) {
+        out.Uint(static_cast<uint32_t>(statements.size()));
+        for (const auto& statement : statements) {
+            WriteNode(out, statement);
+        }
+    }
+
+    // Имя переменной, затем цепочка полей (пустая для простой переменной).
+    // Для цепочки имя совпадает с её первым именем и при чтении не используется
+    void WriteVariable(Output& out, const VariableValue& variable) {
+        out.Uint(String(variable.GetName()));
+        out.Uint(static_cast<uint32_t>(variable.GetDottedIds().size()));
+        for (const auto& id : variable.GetDottedIds()) {
+            out.Uint(String(id));
+        }
+    }
+
+    void WritePrint(Output& out, const Print& print) {
+        const auto& arguments = print.GetArguments();
+        if (!print.GetName().empty()) {
+            WriteTag(out, Tag::PRINT_VARIABLE);
+            out.Uint(String(print.GetName()));
+        } else if (const auto* args = get_if<vector<unique_ptr<Statement>>>(&arguments)) {
+            WriteTag(out, Tag::PRINT_LIST);
+            WriteList(out, *args);
+        } else {
+            WriteTag(out, Tag::PRINT_ONE);
+            WriteNode(out, get<unique_ptr<Statement>>(arguments));
+        }
+    }
+
+    void WriteClass(Output& out, const runtime::Class& cls) {
+        const runtime::Class* parent = cls.GetParent();
+        out.Uint(parent != nullptr ? class_indices_.at(parent) : NO_CLASS);
+
+        const vector<const runtime::Method*> methods = cls.GetOwnMethods();
+        out.Uint(static_cast<uint32_t>(methods.size()));
+        for (const runtime::Method* method : methods) {
+            out.Uint(String(method->name));
+            out.Uint(static_cast<uint32_t>(method->formal_params.size()));
+            for (const auto& param : method->formal_params) {
+                out.Uint(String(param));
+            }
+            WriteNode(out, method->body);
+        }
+    }
+
+    uint32_t String(const string& str) {
+        auto [it, inserted] =
+            string_indices_.try_emplace(str, static_cast<uint32_t>(strings_.size()));
+        if (inserted) {
+            strings_.push_back(str);
+        }
+        return it->second;
+    }
+
+    // Номер класса в таблице классов. Родитель попадает в таблицу раньше наследника
+    uint32_t ClassIndex(const runtime::Class* cls) {
+        if (auto it = class_indices_.find(cls); it != class_indices_.end()) {
+            return it->second;
+        }
+        if (cls->GetParent() != nullptr) {
+            ClassIndex(cls->GetParent());
+        }
+        String(cls->GetName());
+        const auto index = static_cast<uint32_t>(classes_.size());
+        classes_.push_back(cls);
+        class_indices_.emplace(cls, index);
+        return index;
+    }
+
+    static uint8_t ComparatorIndex(const Comparison::Comparator& cmp) {
+        if (const auto* function = cmp.target<Comparator>()) {
+            for (size_t i = 0; i < COMPARATORS.size(); ++i) {
+                if (*function == COMPARATORS[i]) {
+                    return static_cast<uint8_t>(i);
+                }
+            }
+        }
+        throw runtime_error("Cannot serialize a custom comparator"s);
+    }
+
+    vector<string> strings_;
+    unordered_map<string, uint32_t> string_indices_;
+    vector<const runtime::Class*> classes_;
+    unordered_map<const runtime::Class*, uint32_t> class_indices_;
+};
+
+namespace {
+
+class ProgramReader {
+public:
+    ProgramReader(string_view data, Evaluator evaluator)
+        : input_(data)
+        , evaluator_(evaluator) {
+    }
+
+    unique_ptr<Program> Read() {
+        if (input_.Bytes(MAGIC.size()) != MAGIC || input_.Uint() != FORMAT_VERSION) {
+            throw CacheError("Unsupported program cache format"s);
+        }
+        const auto folded_nodes = static_cast<size_t>(input_.U64());
+
+        const uint32_t string_count = input_.Uint();
+        // Каждая строка занимает хотя бы байт: так повреждённый счётчик не вызовет
+        // огромного выделения памяти
+        strings_.reserve(min<size_t>(string_count, input_.Remaining()));
+        for (uint32_t i = 0; i < string_count; ++i) {
+            strings_.emplace_back(input_.Bytes(input_.Uint()));
+        }
+
+        ReadClasses();
+        unique_ptr<Statement> body = ReadNode();
+        if (evaluator_ == Evaluator::LINEAR) {
+            body = Linearize(std::move(body));
+        } else if (evaluator_ == Evaluator::BYTECODE) {
+            body = Compile(std::move(body));
+        }
+        if (input_.Remaining() != 0) {
+            throw CacheError("Unexpected data at the end of program cache"s);
+        }
+        return make_unique<Program>(std::move(body), folded_nodes);
+    }
+
+private:
+    // Сначала создаются заготовки всех классов, чтобы тела методов могли на них ссылаться,
+    // затем заготовки заполняются по порядку: родитель всегда готов раньше наследника
+    void ReadClasses() {
+        const uint32_t class_count = input_.Uint();
+        for (uint32_t i = 0; i < class_count; ++i) {
+            classes_.push_back(ObjectHolder::Own(runtime::Class(String(), {}, nullptr)));
+        }
+        for (uint32_t i = 0; i < class_count; ++i) {
+            const uint32_t parent_index = input_.Uint();
+            if (parent_index != NO_CLASS && parent_index >= i) {
+                throw CacheError("Invalid base class in program cache"s);
+            }
+            const runtime::Class* parent = parent_index == NO_CLASS ? nullptr : &Class(parent_index);
+
+            vector<runtime::Method> methods;
+            for (uint32_t count = input_.Uint(); count > 0; --count) {
+                methods.push_back(ReadMethod());
+            }
+            auto& cls = static_cast<runtime::Class&>(*classes_[i]);  // NOLINT
+            cls = runtime::Class(cls.GetName(), std::move(methods), parent);
+        }
+    }
+
+    runtime::Method ReadMethod() {
+        runtime::Method method;
+        method.name = String();
+        for (uint32_t count = input_.Uint(); count > 0; --count) {
+            method.formal_params.push_back(String());
+        }
+        method.body = ReadNode();
+        if (evaluator_ == Evaluator::TREE) {
+            ResolveLocals(*method.body, method.formal_params);
+        } else if (evaluator_ == Evaluator::LINEAR) {
+            method.body = LinearizeMethod(std::move(method.body), method.formal_params);
+        } else if (evaluator_ == Evaluator::BYTECODE) {
+            method.body = CompileMethod(std::move(method.body), method.formal_params);
+        }
+        return method;
+    }
+
+    unique_ptr<Statement> ReadNode() {
+        const auto tag = static_cast<Tag>(input_.U8());
+        switch (tag) {
+            case Tag::EMPTY:
+                return nullptr;
+            case Tag::NUMBER:
+                return make_unique<NumericConst>(input_.Int());
+            case Tag::STRING:
+                return make_unique<StringConst>(String());
+            case Tag::BOOL:
+                return make_unique<BoolConst>(runtime::Bool(input_.U8() != 0));
+            case Tag::NONE:
+                return make_unique<None>();
+            case Tag::VARIABLE:
+                return make_unique<VariableValue>(ReadVariable());
+            case Tag::ASSIGNMENT: {
+                string var = String();
+                return make_unique<Assignment>(std::move(var), ReadNode());
+            }
+            case Tag::FIELD_ASSIGNMENT: {
+                VariableValue object = ReadVariable();
+                string field_name = String();
+                return make_unique<FieldAssignment>(std::move(object), std::move(field_name),
+                                                    ReadNode());
+            }
+            case Tag::PRINT_VARIABLE:
+                return Print::Variable(String());
+            case Tag::PRINT_ONE:
+                return make_unique<Print>(ReadNode());
+            case Tag::PRINT_LIST:
+                return make_unique<Print>(ReadList());
+            case Tag::METHOD_CALL: {
+                auto object = ReadNode();
+                string method = String();
+                return make_unique<MethodCall>(std::move(object), std::move(method), ReadList());
+            }
+            case Tag::NEW_INSTANCE: {
+                const runtime::Class& cls = Class(input_.Uint());
+                return make_unique<NewInstance>(cls, ReadList());
+            }
+            case Tag::STRINGIFY:
+                return make_unique<Stringify>(ReadNode());
+            case Tag::NOT:
+                return make_unique<Not>(ReadNode());
+            case Tag::NEGATE:
+                return make_unique<Negate>(ReadNode());
+            case Tag::ADD:
+                return ReadBinary<Add>();
+            case Tag::SUB:
+                return ReadBinary<Sub>();
+            case Tag::MULT:
+                return ReadBinary<Mult>();
+            case Tag::DIV:
+                return ReadBinary<Div>();
+            case Tag::OR:
+                return ReadBinary<Or>();
+            case Tag::AND:
+                return ReadBinary<And>();
+            case Tag::COMPARISON: {
+                const uint8_t index = input_.U8();
+                if (index >= COMPARATORS.size()) {
+                    throw CacheError("Invalid comparison in program cache"s);
+                }
+                auto lhs = ReadNode();
+                return make_unique<Comparison>(COMPARATORS[index], std::move(lhs), ReadNode());
+            }
+            case Tag::COMPOUND: {
+                auto compound = make_unique<Compound>();
+                for (auto& statement : ReadList()) {
+                    compound->AddStatement(std::move(statement));
+                }
+                return compound;
+            }
+            case Tag::METHOD_BODY:
+                return make_unique<MethodBody>(ReadNode());
+            case Tag::RETURN:
+                return make_unique<Return>(ReadNode());
+            case Tag::CLASS_DEFINITION: {
+                const uint32_t index = input_.Uint();
+                Class(index);
+                return make_unique<ClassDefinition>(classes_[index]);
+            }
+            case Tag::IF_ELSE: {
+                auto condition = ReadNode();
+                auto if_body = ReadNode();
+                return make_unique<IfElse>(std::move(condition), std::move(if_body), ReadNode());
+            }
+        }
+        throw CacheError("Unknown node in program cache"s);
+    }
+
+    template <typename Operation>
+    unique_ptr<Statement> ReadBinary() {
+        auto lhs = ReadNode();
+        return make_unique<Operation>(std::move(lhs), ReadNode());
+    }
+
+    vector<unique_ptr<Statement>> ReadList() {
+        vector<unique_ptr<Statement>> result;
+        for (uint32_t count = input_.Uint(); count > 0; --count) {
+            result.push_back(ReadNode());
+        }
+        return result;
+    }
+
+    VariableValue ReadVariable() {
+        string var_name = String();
+        vector<string> dotted_ids;
+        for (uint32_t count = input_.Uint(); count > 0; --count) {
+            dotted_ids.push_back(String());
+        }
+        return dotted_ids.empty() ? VariableValue(var_name) : VariableValue(std::move(dotted_ids));
+    }
+
+    const string& String() {
+        const uint32_t index = input_.Uint();
+        if (index >= strings_.size()) {
+            throw CacheError("Invalid string in program cache"s);
+        }
+        return strings_[index];
+    }
+
+    const runtime::Class& Class(uint32_t index) const {
+        if (index >= classes_.size()) {
+            throw CacheError("Invalid class in program cache"s);
+        }
+        return static_cast<const runtime::Class&>(*classes_[index]);  // NOLINT
+    }
+
+    Input input_;
+    Evaluator evaluator_;
+    vector<string> strings_;
+    vector<ObjectHolder> classes_;
+};
+
+// Записывает data в path через временный файл, чтобы параллельно запущенный процесс
+// не прочитал файл наполовину. Ошибки записи не мешают выполнить программу и игнорируются
+void StoreFile(const filesystem::path& path, const string& data) {
+    error_code error;
+    filesystem::create_directories(path.parent_path(), error);
+
+    filesystem::path temp = path;
+    temp += ".tmp"s + to_string(random_device{}());
+    {
+        ofstream out(temp, ios::binary | ios::trunc);
+        if (!out.write(data.data(), static_cast<streamsize>(data.size())) || !out.flush()) {
+            out.close();
+            filesystem::remove(temp, error);
+            return;
+        }
+    }
+    filesystem::rename(temp, path, error);
+    if (error) {
+        filesystem::remove(temp, error);
+    }
+}
+
+}  // namespace
+
+}  // namespace ast
+
+string SerializeProgram(const ast::Program& program) {
+    return ast::ProgramWriter{}.Write(program);
+}
+
+unique_ptr<ast::Program> DeserializeProgram(string_view data, Evaluator evaluator) {
+    return ast::ProgramReader{data, evaluator}.Read();
+}
+
+ProgramCache::ProgramCache(string directory)
+    : directory_(std::move(directory)) {
+}
+
+unique_ptr<ast::Program> ProgramCache::Load(string_view source, Evaluator evaluator,
+                                            size_t threads) {
+    const string path = PathFor(source);
+    const string key = ast::CacheKey(source);
+
+    error_code error;
+    if (filesystem::exists(path, error)) {
+        try {
+            parse::MappedFile file(path);
+            const string_view data = file.Data();
+            if (data.substr(0, key.size()) == key) {
+                auto program = DeserializeProgram(data.substr(key.size()), evaluator);
+                ++hits_;
+                return program;
+            }
+        } catch (const runtime_error&) {
+            // Файл повреждён или не читается: программа разбирается заново
+        }
+    }
+
+    ++misses_;
+    auto program = ParseProgramParallel(source, threads, 64 * 1024, Evaluator::TREE);
+    const string data = key + SerializeProgram(*program);
+    ast::StoreFile(path, data);
+    if (evaluator == Evaluator::TREE) {
+        return program;
+    }
+    return DeserializeProgram(string_view(data).substr(key.size()), evaluator);
+}
+
+size_t ProgramCache::Hits() const {
+    return hits_;
+}
+
+size_t ProgramCache::Misses() const {
+    return misses_;
+}
+
+string ProgramCache::PathFor(string_view source) const {
+    ostringstream name;
+    name << hex << setw(16) << setfill('0') << ast::HashSource(source) << ".mypc"sv;
+    return (filesystem::path(directory_) / name.str()).string();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "parse.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace ast {
+class Program;
+}
+
+// Повреждённые или несовместимые данные кэша
+struct CacheError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+/*
+Записывает разобранную программу в компактный двоичный формат: дерево инструкций,
+объявленные в программе классы и тела их методов. Имена и строки хранятся один раз
+в таблице строк, узлы ссылаются на них номерами.
+Программа должна быть разобрана в представлении Evaluator::TREE с MethodBodies::EAGER,
+иначе выбрасывается runtime_error
+*/
+std::string SerializeProgram(const ast::Program& program);
+
+// Восстанавливает программу из data без лексера и парсера и переводит её
+// в представление evaluator. При повреждённых данных выбрасывает CacheError
+std::unique_ptr<ast::Program> DeserializeProgram(std::string_view data,
+                                                 Evaluator evaluator = Evaluator::TREE);
+
+/*
+Каталог с разобранными программами. Файл программы назван по хешу её исходного текста,
+поэтому повторный запуск той же программы не вызывает ни лексер, ни парсер.
+Устаревшие и повреждённые файлы разбираются заново и перезаписываются
+*/
+class ProgramCache {
+public:
+    explicit ProgramCache(std::string directory);
+
+    // Возвращает программу source из кэша либо разбирает её на threads потоках
+    // и сохраняет в кэш. Ошибки разбора те же, что у ParseProgramParallel
+    std::unique_ptr<ast::Program> Load(std::string_view source, Evaluator evaluator,
+                                       size_t threads = 1);
+
+    // Сколько раз программа нашлась в кэше и сколько раз пришлось её разбирать
+    [[nodiscard]] size_t Hits() const;
+    [[nodiscard]] size_t Misses() const;
+
+    // Путь к файлу кэша для исходного текста source
+    [[nodiscard]] std::string PathFor(std::string_view source) const;
+
+private:
+    std::string directory_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
@@ -0,0 +1,35 @@
+#include "field_cache.h"
+
+namespace runtime {
+
+FieldCache::Entry& FieldCache::Miss(const Shape& shape, const std::string& name) {
+    ++misses_;
+    const Entry entry{&shape, shape.Find(name), nullptr};
+    if (megamorphic_) {
+        return uncached_ = entry;
+    }
+    if (size_ == CAPACITY) {
+        megamorphic_ = true;
+        size_ = 0;
+        return uncached_ = entry;
+    }
+    return entries_[size_++] = entry;
+}
+
+size_t FieldCache::Hits() const {
+    return hits_;
+}
+
+size_t FieldCache::Misses() const {
+    return misses_;
+}
+
+size_t FieldCache::Size() const {
+    return size_;
+}
+
+bool FieldCache::IsMegamorphic() const {
+    return megamorphic_;
+}
+
+}  // namespace runtime
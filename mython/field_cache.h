@@ -0,0 +1,78 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace runtime {
+
+// Встроенный кэш обращения к полю: для форм объектов, встреченных в этом месте, запоминает
+// номер ячейки поля либо переход, добавляющий поле. Повторное обращение к объекту той же формы
+// обходится без поиска имени. Как и MethodCache, кэш хранит не больше CAPACITY форм,
+// а место с большим числом форм становится мегаморфным и дальше ищет поле в форме
+class FieldCache {
+public:
+    static constexpr size_t CAPACITY = 4;
+
+    // Возвращает ячейку поля name либо nullptr, если такого поля нет.
+    // Место обращения всегда передаёт одно и то же name
+    ObjectHolder* Find(FieldTable& fields, const std::string& name) {
+        const Entry& entry = Lookup(fields.GetShape(), name);
+        return entry.slot != Shape::NOT_FOUND ? &fields.Slot(entry.slot) : nullptr;
+    }
+
+    // Возвращает ячейку поля name, добавляя поле со значением None, если его нет
+    ObjectHolder& Insert(FieldTable& fields, const std::string& name) {
+        Entry& entry = Lookup(fields.GetShape(), name);
+        if (entry.slot != Shape::NOT_FOUND) {
+            return fields.Slot(entry.slot);
+        }
+        if (entry.next == nullptr) {
+            entry.next = &entry.shape->With(name);
+        }
+        return fields.Append(*entry.next);
+    }
+
+    // Сколько раз форма нашлась в кэше и сколько раз поле пришлось искать в форме
+    [[nodiscard]] size_t Hits() const;
+    [[nodiscard]] size_t Misses() const;
+
+    // Сколько форм сейчас в кэше
+    [[nodiscard]] size_t Size() const;
+
+    [[nodiscard]] bool IsMegamorphic() const;
+
+private:
+    // Для формы без поля slot равен Shape::NOT_FOUND, а next - форма с добавленным полем,
+    // которая вычисляется при первом добавлении
+    struct Entry {
+        const Shape* shape = nullptr;
+        size_t slot = Shape::NOT_FOUND;
+        const Shape* next = nullptr;
+    };
+
+    Entry& Lookup(const Shape& shape, const std::string& name) {
+        for (uint32_t i = 0; i < size_; ++i) {
+            if (entries_[i].shape == &shape) {
+                ++hits_;
+                return entries_[i];
+            }
+        }
+        return Miss(shape, name);
+    }
+
+    Entry& Miss(const Shape& shape, const std::string& name);
+
+    std::array<Entry, CAPACITY> entries_;
+    // Результат поиска мимо кэша в мегаморфном месте
+    Entry uncached_;
+    uint32_t size_ = 0;
+    bool megamorphic_ = false;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+}  // namespace runtime
@@ -1,251 +1,326 @@
 #include "lexer.h"
+#include "scan.h"
 
 #include <algorithm>
+#include <array>
 #include <charconv>
+#include <cstdint>
+#include <functional>
 
 #include <string_view>
 #include <iostream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
 
 
 using namespace std;
 
 namespace parse {
-   
-    void Lexer::PrepareForNewTokenReading(size_t num) {
-        if (num > input_string_.size()) {
-            return;
+
+namespace {
+
+    // Классы символов, по которым первый символ лексемы выбирает ветку разбора
+    enum class CharClass : unsigned char {
+        OTHER,
+        SPACE,
+        DIGIT,
+        ID,
+        QUOTE,
+        COMMENT,
+        COMPARE,
+        END_OF_LINE
+    };
+
+    constexpr std::array<CharClass, 256> MakeCharClassTable() {
+        std::array<CharClass, 256> table{};
+        for (auto& cls : table) {
+            cls = CharClass::OTHER;
         }
-        pos_ = 0;
-        input_string_.remove_prefix(num);
+        table[static_cast<unsigned char>(' ')] = CharClass::SPACE;
+        table[static_cast<unsigned char>('\r')] = CharClass::SPACE;
+        table[static_cast<unsigned char>('\n')] = CharClass::END_OF_LINE;
+        for (char ch = '0'; ch <= '9'; ++ch) {
+            table[static_cast<unsigned char>(ch)] = CharClass::DIGIT;
+        }
+        for (char ch = 'a'; ch <= 'z'; ++ch) {
+            table[static_cast<unsigned char>(ch)] = CharClass::ID;
+        }
+        for (char ch = 'A'; ch <= 'Z'; ++ch) {
+            table[static_cast<unsigned char>(ch)] = CharClass::ID;
+        }
+        table[static_cast<unsigned char>('_')] = CharClass::ID;
+        table[static_cast<unsigned char>('"')] = CharClass::QUOTE;
+        table[static_cast<unsigned char>('\'')] = CharClass::QUOTE;
+        table[static_cast<unsigned char>('#')] = CharClass::COMMENT;
+        table[static_cast<unsigned char>('<')] = CharClass::COMPARE;
+        table[static_cast<unsigned char>('>')] = CharClass::COMPARE;
+        table[static_cast<unsigned char>('!')] = CharClass::COMPARE;
+        table[static_cast<unsigned char>('=')] = CharClass::COMPARE;
+        return table;
     }
 
-    token_type::String Lexer::LoadString(size_t pos) {
-        std::string s;
-        s.reserve(pos);
-        for (size_t i = 1; i < pos; i++) {
-            auto ch = input_string_[i];
-            if (ch == '\\') {
-                i++;
-                if (i == pos) {
-                    throw LexerError("String parsing error");
-                }
-                const char escaped_char = input_string_[i];
-                switch (escaped_char) {
-                case 'n':
-                    s.push_back('\n');
-                    break;
-                case 't':
-                    s.push_back('\t');
-                    break;
-                case 'r':
-                    s.push_back('\r');
-                    break;
-                case '"':
-                    s.push_back('"');
-                    break;
-                case '\'':
-                    s.push_back('\'');
-                    break;
-                case '\\':
-                    s.push_back('\\');
-                    break;
-                default:
-                    throw LexerError("Unrecognized escape sequence \\"s + escaped_char);
-                }
-            }
-            else if (ch == '\n' || ch == '\r') {
-                throw LexerError("Unexpected end of line"s);
-            }
-            else {
-                s.push_back(ch);
-            }
-        }
-        return token_type::String{s};
+    constexpr std::array<CharClass, 256> CHAR_CLASSES = MakeCharClassTable();
+
+    inline CharClass ClassOf(char ch) {
+        return CHAR_CLASSES[static_cast<unsigned char>(ch)];
     }
 
-    ANSWER Lexer::IsString() {
-        
-        if ((input_string_[0] == '"') || (input_string_[0] == '\'')) {
-            if (pos_ == 0) {
-                return MAYBE;
-            }
-            if (((input_string_[0] == '"')&& (input_string_[pos_] == '"') && (input_string_[pos_ - 1] != '\\')) ||
-                (((input_string_[0] == '\'') && input_string_[pos_] == '\'') && (input_string_[pos_ - 1] != '\\'))) {
+    inline bool IsIdChar(char ch) {
+        const CharClass cls = ClassOf(ch);
+        return cls == CharClass::ID || cls == CharClass::DIGIT;
+    }
 
-                current_token_ = std::move(LoadString(pos_));
-                PrepareForNewTokenReading(pos_+1);
-              
-                return current_token_;
-            }
-            return MAYBE;
+    // Индекс первого значимого символа строки или npos, если строка пустая,
+    // состоит из одних пробелов либо содержит только комментарий
+    size_t FindLineStart(std::string_view line) {
+        size_t pos = scan::FindFirstNonSpace(line);
+        while (pos < line.size() && ClassOf(line[pos]) == CharClass::SPACE) {
+            ++pos;
+        }
+        if (pos == line.size() || line[pos] == '#') {
+            return std::string_view::npos;
         }
-        return {};
+        return pos;
     }
 
-    ANSWER Lexer::IsNumber() {
+    // 64-битный FNV-1a строки вместе с уровнем отступа, с которым она встретилась
+    std::uint64_t HashLine(std::string_view text, int level) {
+        std::uint64_t hash = 14695981039346656037ull ^ static_cast<std::uint64_t>(level);
+        for (const char ch : text) {
+            hash = (hash ^ static_cast<unsigned char>(ch)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+} // namespace
 
-        parse::token_type::Number output;
+    bool Lexer::ReadNextString() {
+        do {
+            while (next_line_ < source_.size()) {
+                const size_t line_end = next_line_ + scan::FindLineEnd(source_.substr(next_line_));
+                input_string_ = source_.substr(next_line_, line_end - next_line_);
+                next_line_ = line_end + 1;
 
-        if (std::isdigit(input_string_[pos_])) {
-            if (pos_ == input_string_.size() - 1) {
-                output.value = stoi(string(input_string_.substr(0, pos_ + 1)));
-                PrepareForNewTokenReading(pos_ + 1);
-                current_token_ = std::move(output);
-                return current_token_;
+                const size_t start = FindLineStart(input_string_);
+                if (start != std::string_view::npos) {
+                    pos_ = start;
+                    ident_control_.curr_ = static_cast<int>(start / 2);
+                    return true;
+                }
             }
-            return MAYBE;
+        } while (ReadNextBlock());
+        input_string_ = {};
+        pos_ = 0;
+        ident_control_.curr_ = 0;
+        return false;
+    }
+
+    // Читает из input_ очередной блок, заканчивающийся концом строки
+    // (или концом потока), и делает его текущим исходным текстом
+    bool Lexer::ReadNextBlock() {
+        static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+        if (input_ == nullptr) {
+            return false;
         }
-        else if (pos_ != 0) {
-            output.value = stoi(string(input_string_.substr(0, pos_)));
-            PrepareForNewTokenReading(pos_);
-            current_token_ = std::move(output);
-            return current_token_;
 
+        std::string block = std::move(partial_line_);
+        partial_line_.clear();
+        size_t line_end = std::string::npos;
+        while (line_end == std::string::npos && *input_) {
+            const size_t old_size = block.size();
+            block.resize(old_size + BLOCK_SIZE);
+            input_->read(block.data() + old_size, BLOCK_SIZE);
+            block.resize(old_size + static_cast<size_t>(input_->gcount()));
+            line_end = block.rfind('\n');
+            if (line_end != std::string::npos && line_end < old_size) {
+                line_end = std::string::npos;
+            }
         }
-        return {};
-    }
 
-    ANSWER Lexer::IsId() {
-        auto ch = input_string_[pos_];
-        if ((std::isdigit(ch) && (pos_ != 0))||  std::isalpha(ch) || (ch =='_')) {
-                if ((pos_ != input_string_.size()-1) &&
-                    (std::isdigit(input_string_[pos_+1])||
-                     std::isalpha(input_string_[pos_+1])||
-                     (input_string_[pos_ + 1] == '_'))) {
-                    return MAYBE;
-                }
+        if (line_end != std::string::npos) {
+            partial_line_ = block.substr(line_end + 1);
+            block.resize(line_end + 1);
         }
-        else if (pos_ == 0) {
-            return {};
+        else if (block.empty()) {
+            input_ = nullptr;
+            return false;
         }
-        token_type::Id output;
-        output.value = string(input_string_.substr(0, pos_+1));
-        PrepareForNewTokenReading(pos_+1);
-        current_token_ = output;
-        return current_token_;
+
+        source_ = blocks_.emplace_back(std::move(block));
+        next_line_ = 0;
+        return true;
     }
 
-    ANSWER Lexer::IsDoubleOperation() {
-        if (pos_ == 0) {
-            if ((input_string_[pos_] == '<') || (input_string_[pos_] == '>') || (input_string_[pos_] == '!') || (input_string_[pos_] == '=')) {
-                return MAYBE;
+    Token Lexer::ReadToken() {
+        if (at_line_start_ && ident_control_.last_ == ident_control_.curr_) {
+            if (ReadNextString()) {
+                at_line_start_ = false;
             }
-        }
-        else if (input_string_[pos_] == '=') { //<= >= != ==
-            if (input_string_[pos_ - 1] == '<') {
-                current_token_ = token_type::LessOrEq();
-            }
-
-            else if (input_string_[pos_ - 1] == '>') {
-                current_token_ = token_type::GreaterOrEq();
+            else if (ident_control_.last_ == 0) {
+                return token_type::Eof{};
             }
+        }
 
-            else if (input_string_[pos_ - 1] == '!') {
-                current_token_ = token_type::NotEq();
-            }
-            else {
-                current_token_ = token_type::Eq();
-            }
-            PrepareForNewTokenReading(pos_ + 1);
-            return current_token_;
+        if (ident_control_.curr_ > ident_control_.last_) {
+            ++ident_control_.last_;
+            return token_type::Indent{};
+        }
+        if (ident_control_.curr_ < ident_control_.last_) {
+            --ident_control_.last_;
+            return token_type::Dedent{};
         }
 
-        return {};
+        return ScanToken();
     }
 
-    ANSWER Lexer::IsChar() {
-
-        if (((input_string_[pos_] == '+') || (input_string_[pos_] == '-') || (input_string_[pos_] == ':') || 
-            (input_string_[pos_] == '(') ||  (input_string_[pos_] == '*') || (input_string_[pos_] == '/') ||
-            (input_string_[pos_] == ',') || (input_string_[pos_] == '.') || (input_string_[pos_] == ')')) ||
-            (((input_string_[pos_] == '<') || (input_string_[pos_] == '>') || (input_string_[pos_] == '=')) &&
-            ((pos_ == input_string_.size() - 1) || (input_string_[pos_ + 1] != '=')))) { // + - * /
-
-                token_type::Char output;
-                output.value = input_string_[pos_];
-                current_token_ = output;
-                PrepareForNewTokenReading(pos_ + 1);
-            return current_token_;
+    Token Lexer::ScanToken() {
+        while (pos_ < input_string_.size() && ClassOf(input_string_[pos_]) == CharClass::SPACE) {
+            ++pos_;
         }
-        return {};
-    }
 
-    ANSWER Lexer::IsComment() {
-        if (input_string_[pos_] == '#') {
-            PrepareForNewTokenReading(input_string_.size());
-            return COMMENT;
+        if (pos_ == input_string_.size()) {
+            at_line_start_ = true;
+            return token_type::Newline{};
         }
-        return{};
-    }
 
-    bool Lexer::IsIndent() {
-        if ((input_string_[pos_] == ' ') && (input_string_[pos_ + 1] == ' ')) {
-             PrepareForNewTokenReading(2);
-             return true;
-         }
-       return false;
+        switch (ClassOf(input_string_[pos_])) {
+        case CharClass::DIGIT:
+            return ScanNumber();
+        case CharClass::ID:
+            return ScanIdOrKeyword();
+        case CharClass::QUOTE:
+            return ScanString();
+        case CharClass::COMPARE:
+            return ScanOperation();
+        case CharClass::COMMENT:
+        case CharClass::END_OF_LINE:
+            pos_ = input_string_.size();
+            at_line_start_ = true;
+            return token_type::Newline{};
+        default:
+            return token_type::Char{input_string_[pos_++]};
+        }
     }
-  
-    ANSWER Lexer::IndentControl() {
 
-        if (pos_ >= input_string_.size()) {
-            return token_type::Dedent{};
+    Token Lexer::ScanNumber() {
+        const size_t start = pos_;
+        while (pos_ < input_string_.size() && ClassOf(input_string_[pos_]) == CharClass::DIGIT) {
+            ++pos_;
         }
 
-        while (IsIndent()) {
-            if (++ident_control_.curr_ > ident_control_.last_) {
-                return token_type::Indent{};
-            }
+        token_type::Number output{};
+        const char* first = input_string_.data() + start;
+        const char* last = input_string_.data() + pos_;
+        if (std::from_chars(first, last, output.value).ec != std::errc{}) {
+            throw LexerError("Number is out of range: "s + std::string(first, last));
         }
+        return output;
+    }
 
-        if (ident_control_.curr_ < ident_control_.last_) {
-            ident_control_.last_--;
-            return token_type::Dedent{};
+    Token Lexer::ScanIdOrKeyword() {
+        const size_t start = pos_;
+        while (pos_ < input_string_.size() && IsIdChar(input_string_[pos_])) {
+            ++pos_;
         }
-        
-        ident_control_.last_ = ident_control_.curr_;
 
-        return {};
+        const std::string_view word = input_string_.substr(start, pos_ - start);
+        if (auto keyword = FindKeyword(word)) {
+            return *keyword;
+        }
+        return token_type::Id{word};
     }
 
-    ANSWER Lexer::IsEof() {
+    Token Lexer::ScanString() {
+        const char quote = input_string_[pos_];
+        const size_t start = pos_ + 1;
+        bool has_escapes = false;
 
-        if (input_stream_.eof()){
-               current_token_ = token_type::Eof();
-               if (ident_control_.last_ == 0) {
-                   return current_token_;
-               }
-               else {
-                   ident_control_.last_--;
-                   return token_type::Dedent{};
-               }
+        for (pos_ = start; pos_ < input_string_.size(); ++pos_) {
+            pos_ += scan::FindStringEnd(input_string_.substr(pos_), quote);
+            if (pos_ == input_string_.size()) {
+                break;
+            }
+            const char ch = input_string_[pos_];
+            if (ch == quote) {
+                const std::string_view literal = input_string_.substr(start, pos_ - start);
+                ++pos_;
+                return token_type::String{has_escapes ? DecodeString(literal) : literal};
+            }
+            if (ch == '\\') {
+                has_escapes = true;
+                ++pos_;
+            }
+            else if (ch == '\n' || ch == '\r') {
+                break;
+            }
         }
-        return {};
+        throw LexerError("Unexpected end of line"s);
     }
 
-    ANSWER Lexer::IsNewline() {
-        if (input_string_.empty()) {
-            current_token_ = token_type::Newline();
-            return current_token_;
-        }
-        return {};
-    }
+    std::string_view Lexer::DecodeString(std::string_view literal) {
+        std::string& s = decoded_strings_.emplace_back();
+        s.reserve(literal.size());
 
-    void Lexer::ReadNextString() {
-        while (!input_stream_.eof() && (/*input_string_.empty() || */
-            (find_if_not(input_string_.begin(), input_string_.end(),
-                         [](const auto& ch) {return (ch == ' ');})==input_string_.end()))) {
-            getline(input_stream_, in_str_);
-            input_string_ = in_str_;
+        for (size_t i = 0; i < literal.size(); ++i) {
+            const char ch = literal[i];
+            if (ch != '\\') {
+                s.push_back(ch);
+                continue;
+            }
+            const char escaped_char = literal[++i];
+            switch (escaped_char) {
+            case 'n':
+                s.push_back('\n');
+                break;
+            case 't':
+                s.push_back('\t');
+                break;
+            case 'r':
+                s.push_back('\r');
+                break;
+            case '"':
+                s.push_back('"');
+                break;
+            case '\'':
+                s.push_back('\'');
+                break;
+            case '\\':
+                s.push_back('\\');
+                break;
+            default:
+                throw LexerError("Unrecognized escape sequence \\"s + escaped_char);
+            }
         }
+        return s;
+    }
 
-       if (input_string_.empty() && input_stream_.eof()) {
-            current_token_ = token_type::Eof{};
+    Token Lexer::ScanOperation() {
+        const char ch = input_string_[pos_++];
+        if (pos_ < input_string_.size() && input_string_[pos_] == '=') {
+            ++pos_;
+            switch (ch) {
+            case '<':
+                return token_type::LessOrEq{};
+            case '>':
+                return token_type::GreaterOrEq{};
+            case '!':
+                return token_type::NotEq{};
+            default:
+                return token_type::Eq{};
+            }
         }
-        ident_control_.curr_ = 0;
+        return token_type::Char{ch};
+    }
 
-   }
-    
     bool operator==(const Token& lhs, const Token& rhs) {
         using namespace token_type;
 
@@ -313,93 +388,332 @@ namespace parse {
         return os << "Unknown token :("sv;
     }
 
-    Lexer::Lexer(std::istream& input)
-        : input_stream_(input) {
-
-        LEXEMS_LIST = { &Lexer::IsKeyword<0>, 
-                        &Lexer::IsKeyword<1>, &Lexer::IsKeyword<2>, &Lexer::IsKeyword<3>, &Lexer::IsKeyword<4>, 
-                        &Lexer::IsKeyword<5>, &Lexer::IsKeyword<6>, &Lexer::IsKeyword<7>, &Lexer::IsKeyword<8>, 
-                        &Lexer::IsKeyword<9>, &Lexer::IsKeyword<10>, &Lexer::IsKeyword<11>, &Lexer::IsString, &Lexer::IsNumber,
-                        &Lexer::IsId, &Lexer::IsDoubleOperation, &Lexer::IsChar, &Lexer::IsComment };
-        
-        KEYWORDS_NAMES_.reserve(name_to_lexem.size());
+    MappedFile::MappedFile(const std::string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file "s + path);
+        }
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Cannot stat file "s + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ != 0) {
+            void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Cannot map file "s + path);
+            }
+            data_ = static_cast<const char*>(addr);
+        }
+        close(fd);
+#else
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            throw std::runtime_error("Cannot open file "s + path);
+        }
+        fallback_.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        data_ = fallback_.data();
+        size_ = fallback_.size();
+#endif
+    }
 
-        for (auto& [name, _] : name_to_lexem) {
-            KEYWORDS_NAMES_.push_back(name);
+    MappedFile::~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
         }
+#endif
+    }
 
-        ReadNextString();
+    std::string_view MappedFile::Data() const {
+        return {data_, size_};
+    }
 
+    Lexer::Lexer(std::istream& input, Mode mode) {
+        if (mode == Mode::PIPELINED) {
+            input_ = &input;
+            StartProducer();
+            return;
+        }
+
+        owned_source_.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        source_ = owned_source_;
         NextToken();
-        if (current_token_ == token_type::Newline{}) {
+    }
+
+    Lexer::Lexer(std::string_view source, Mode mode)
+        : source_(source) {
+        if (mode == Mode::PIPELINED) {
+            StartProducer();
+        }
+        else {
             NextToken();
         }
     }
 
-    const Token& Lexer::CurrentToken() const {
-        return current_token_;
+    Lexer::~Lexer() {
+        if (producer_.joinable()) {
+            stop_producer_.store(true, std::memory_order_relaxed);
+            producer_.join();
+        }
     }
 
-    Token Lexer::NextToken() {
+    void Lexer::StartProducer() {
+        static constexpr size_t QUEUE_CAPACITY = 4096;
 
-        if (current_token_ == token_type::Eof{}) {
-            if (ident_control_.last_ == 0) {
-                return current_token_;
-            }
-            else {
-                return token_type::Dedent{};
-            }
+        queue_ = std::make_unique<SpscRing<Token>>(QUEUE_CAPACITY);
+        producer_ = std::thread([this] {
+            RunProducer();
+        });
+        try {
+            NextToken();
+        } catch (...) {
+            // Деструктор не будет вызван, поток нужно остановить здесь
+            stop_producer_.store(true, std::memory_order_relaxed);
+            producer_.join();
+            throw;
         }
+    }
 
-        if ((current_token_ != token_type::Newline{}) && IsNewline().has_value()) {
-            return token_type::Newline{};
+    void Lexer::RunProducer() {
+        try {
+            for (bool eof = false; !eof;) {
+                // Разбор мог закончиться раньше, например на ошибке: дальше читать незачем
+                if (stop_producer_.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                Token token = ReadToken();
+                eof = token.Is<token_type::Eof>();
+                while (!queue_->TryPush(std::move(token))) {
+                    if (stop_producer_.load(std::memory_order_relaxed)) {
+                        return;
+                    }
+                    std::this_thread::yield();
+                }
+            }
+        } catch (...) {
+            producer_error_ = std::current_exception();
         }
-        
-        if (current_token_ == token_type::Newline{}) {
-            ReadNextString();
-            auto temp = IsEof();
-            if (temp.has_value()) {
-                return get<Token>(temp.value());
+        producer_done_.store(true, std::memory_order_release);
+    }
+
+    Token Lexer::FetchToken() {
+        if (span_pos_ != nullptr) {
+            while (span_pos_ == spans_[span_index_].end) {
+                if (++span_index_ == spans_.size()) {
+                    span_pos_ = nullptr;
+                    return token_type::Eof{};
+                }
+                span_pos_ = spans_[span_index_].begin;
             }
+            return *span_pos_++;
+        }
+        if (!spans_.empty()) {
+            return token_type::Eof{};
+        }
+        if (!queue_) {
+            return ReadToken();
         }
 
-        if ((current_token_ == token_type::Newline{})||
-            (ident_control_.curr_ != ident_control_.last_)) {
-                ANSWER ident = IndentControl();
-                if (ident.has_value()) {
-                    current_token_ = get<Token>(ident.value());
-                    return current_token_;
+        Token token;
+        while (!queue_->TryPop(token)) {
+            if (producer_done_.load(std::memory_order_acquire)) {
+                // Лексемы, положенные до завершения потока, уже видны
+                if (queue_->TryPop(token)) {
+                    return token;
+                }
+                if (producer_error_) {
+                    std::rethrow_exception(producer_error_);
                 }
+                return token_type::Eof{};
+            }
+            std::this_thread::yield();
         }
+        return token;
+    }
 
-        std::vector<list<ANSWER(Lexer::*)()>::iterator> for_erase_lexems;
-        for_erase_lexems.reserve(LEXEMS_LIST.size());
-        auto  lexem_list = LEXEMS_LIST;
+    Lexer::Lexer(std::vector<TokenSpan> spans)
+        : spans_(std::move(spans)) {
+        span_pos_ = spans_.empty() ? nullptr : spans_.front().begin;
+        NextToken();
+    }
 
-        while (pos_!= input_string_.size()) {
+    const Token& Lexer::CurrentToken() const {
+        return current_token_;
+    }
 
-            for (auto it = lexem_list.begin(); it != lexem_list.end(); ++it) {
-                ANSWER temp = (this->*(*it))();
-                if (temp.has_value()) {
-                    if (temp.value().index() == 0){
-                            PrepareForNewTokenReading(input_string_.find_first_not_of(' '));                 
-                        return std::get<Token>(temp.value());
-                    }
-                    else if ((temp.value().index() == 1) && (get<STATE>(temp.value())==STATE::COMMENT)){
-                        current_token_ = token_type::Newline{};
-                        return token_type::Newline{};
-                    }
+    const Token& Lexer::NextToken() {
+        if (!lookahead_.empty()) {
+            current_token_ = lookahead_.front();
+            lookahead_.pop_front();
+        }
+        else {
+            current_token_ = FetchToken();
+        }
+        return current_token_;
+    }
+
+    Token Lexer::PeekToken(size_t offset) {
+        if (offset == 0) {
+            return current_token_;
+        }
+        while (lookahead_.size() < offset) {
+            lookahead_.push_back(FetchToken());
+        }
+        return lookahead_[offset - 1];
+    }
+
+    const std::vector<TokenSpan>& IncrementalLexer::Lex(std::string_view source) {
+        ++generation_;
+        relexed_lines_ = 0;
+        previous_lines_.swap(lines_);
+        lines_.clear();
+        previous_cursor_ = 0;
+        spans_.clear();
+        tail_.clear();
+
+        int level = 0;
+        try {
+            for (size_t line_start = 0; line_start < source.size();) {
+                const size_t line_end = line_start + scan::FindLineEnd(source.substr(line_start));
+                const std::string_view line = source.substr(line_start, line_end - line_start);
+                line_start = line_end + 1;
+
+                // Пустые строки и комментарии лексем не дают
+                if (FindLineStart(line) == std::string_view::npos) {
+                    continue;
                 }
-                else {
-                    for_erase_lexems.push_back(it);
+                const LineRun* run = FindInPreviousLines(line, level);
+                if (run == nullptr) {
+                    run = &FindOrLexLine(line, level);
                 }
+                spans_.push_back({run->tokens.data(), run->tokens.data() + run->tokens.size()});
+                level = run->level_out;
             }
-            for (auto to_erase : for_erase_lexems) {
-                lexem_list.erase(to_erase);
+        } catch (...) {
+            // После ошибки неизвестно, какие строки ещё нужны, поэтому кэш сбрасывается
+            runs_.clear();
+            lines_.clear();
+            previous_lines_.clear();
+            spans_.clear();
+            throw;
+        }
+        for (; level > 0; --level) {
+            tail_.push_back(token_type::Dedent{});
+        }
+        tail_.push_back(token_type::Eof{});
+        spans_.push_back({tail_.data(), tail_.data() + tail_.size()});
+
+        EvictUnusedLines();
+        return spans_;
+    }
+
+    // Ищет строку среди ближайших строк предыдущей версии программы после уже
+    // совпавших. Окна хватает, чтобы после вставки, замены или удаления нескольких
+    // строк снова идти по предыдущей версии без хеширования
+    const IncrementalLexer::LineRun* IncrementalLexer::FindInPreviousLines(std::string_view text, int level_in) {
+        static constexpr size_t WINDOW = 16;
+
+        const size_t end = std::min(previous_lines_.size(), previous_cursor_ + WINDOW);
+        for (size_t i = previous_cursor_; i < end; ++i) {
+            LineRun* run = previous_lines_[i];
+            if (run->level_in == level_in && run->text == text) {
+                previous_cursor_ = i + 1;
+                run->generation = generation_;
+                lines_.push_back(run);
+                return run;
             }
-            for_erase_lexems.clear();
-            ++pos_;
-        }   
-        return{};
-    } 
-} // namespace parse
\ No newline at end of file
+        }
+        return nullptr;
+    }
+
+    // Удаляет строки предыдущей версии, которые не встретились в текущей
+    void IncrementalLexer::EvictUnusedLines() {
+        std::vector<LineRun*> unused;
+        for (LineRun* run : previous_lines_) {
+            // Одна и та же строка может встречаться несколько раз, отмечаем её один раз
+            if (run->generation + 1 == generation_) {
+                run->generation = 0;
+                unused.push_back(run);
+            }
+        }
+        previous_lines_.clear();
+
+        for (const LineRun* run : unused) {
+            auto bucket = runs_.find(run->hash);
+            auto& runs = bucket->second;
+            runs.erase(std::find_if(runs.begin(), runs.end(), [run](const auto& candidate) {
+                return candidate.get() == run;
+            }));
+            if (runs.empty()) {
+                runs_.erase(bucket);
+            }
+        }
+    }
+
+    size_t IncrementalLexer::RelexedLines() const {
+        return relexed_lines_;
+    }
+
+    const IncrementalLexer::LineRun& IncrementalLexer::FindOrLexLine(std::string_view text, int level_in) {
+        const std::uint64_t hash = HashLine(text, level_in);
+        auto& bucket = runs_[hash];
+        for (const auto& run : bucket) {
+            if (run->level_in == level_in && run->text == text) {
+                run->generation = generation_;
+                lines_.push_back(run.get());
+                return *run;
+            }
+        }
+
+        ++relexed_lines_;
+        auto run = std::make_unique<LineRun>();
+        run->text = std::string(text);
+        run->hash = hash;
+        run->level_in = level_in;
+        run->generation = generation_;
+
+        // Строка разбирается отдельным лексером: сначала идут Indent до её уровня,
+        // затем лексемы строки до Newline включительно
+        Lexer lexer(std::string_view{run->text});
+        for (; lexer.CurrentToken().Is<token_type::Indent>(); lexer.NextToken()) {
+            ++run->level_out;
+        }
+        std::vector<Token> body;
+        for (bool newline = false; !newline; lexer.NextToken()) {
+            newline = lexer.CurrentToken().Is<token_type::Newline>();
+            body.push_back(lexer.CurrentToken());
+        }
+
+        // Строки с escape-последовательностями живут в лексере строки, их нужно скопировать.
+        // Память резервируется заранее, чтобы ссылки на скопированные строки не менялись
+        const std::string_view own_text = run->text;
+        auto points_into_text = [&own_text](std::string_view value) {
+            return std::less_equal<>{}(own_text.data(), value.data())
+                && std::less_equal<>{}(value.data() + value.size(), own_text.data() + own_text.size());
+        };
+        run->decoded.reserve(std::count_if(body.begin(), body.end(), [&](const Token& token) {
+            const auto* str = token.TryAs<token_type::String>();
+            return str != nullptr && !points_into_text(str->value);
+        }));
+        for (Token& token : body) {
+            if (const auto* str = token.TryAs<token_type::String>(); str != nullptr && !points_into_text(str->value)) {
+                token = token_type::String{run->decoded.emplace_back(str->value)};
+            }
+        }
+
+        for (int level = level_in; level < run->level_out; ++level) {
+            run->tokens.push_back(token_type::Indent{});
+        }
+        for (int level = level_in; level > run->level_out; --level) {
+            run->tokens.push_back(token_type::Dedent{});
+        }
+        run->tokens.insert(run->tokens.end(), body.begin(), body.end());
+
+        lines_.push_back(run.get());
+        return *bucket.emplace_back(std::move(run));
+    }
+} // namespace parse
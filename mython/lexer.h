@@ -1,15 +1,21 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <exception>
 #include <iosfwd>
+#include <memory>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <variant>
 #include <string_view>
-#include <list>
 #include <vector>
-#include <unordered_map>
+
+#include "spsc_ring.h"
 
 namespace parse {
 
@@ -18,8 +24,10 @@ struct Number {  // Лексема «число»
     int value;   // число
 };
 
-struct Id {             // Лексема «идентификатор»
-    std::string value;  // Имя идентификатора
+// Значения Id и String указывают в исходный буфер лексера (или в его хранилище
+// строк с escape-последовательностями) и действительны, пока жив лексер
+struct Id {                  // Лексема «идентификатор»
+    std::string_view value;  // Имя идентификатора
 };
 
 struct Char {    // Лексема «символ»
@@ -27,7 +35,7 @@ struct Char {    // Лексема «символ»
 };
 
 struct String {  // Лексема «строковая константа»
-    std::string value;
+    std::string_view value;
 };
 
 struct Class {};    // Лексема «class»
@@ -60,13 +68,6 @@ using TokenBase
                    token_type::Eq, token_type::NotEq, token_type::LessOrEq, token_type::GreaterOrEq,
                    token_type::None, token_type::True, token_type::False, token_type::Eof>;
 
-enum STATE {
-    MAYBE,
-    COMMENT
-};
-
-
-
 struct Token : TokenBase {
     using TokenBase::TokenBase;
 
@@ -85,13 +86,68 @@ struct Token : TokenBase {
         return std::get_if<T>(this);
     }
 };
-using ANSWER = std::optional<std::variant<Token, STATE>>;
 
-const static std::unordered_map<std::string, Token> name_to_lexem = { {"class", token_type::Class()}, {"return", token_type::Return()},
-                                                               { "if", token_type::If() }, { "else", token_type::Else() }, { "def", token_type::Def() },
-                                                               { "and", token_type::And() }, {"or", token_type::Or()}, {"not", token_type::Not()}, {"print", token_type::Print()},
-                                                               {"None", token_type::None()}, {"True", token_type::True()},  {"False", token_type::False()} };
+// Непрерывный отрезок готовых лексем [begin, end)
+struct TokenSpan {
+    const Token* begin = nullptr;
+    const Token* end = nullptr;
+};
 
+// Возвращает лексему ключевого слова word либо std::nullopt, если word - идентификатор.
+// Выбор делается по длине и первому символу, поэтому проверка стоит не больше
+// одного сравнения строк и не требует инициализации во время выполнения
+constexpr std::optional<Token> FindKeyword(std::string_view word) {
+    using namespace std::literals;
+
+    if (word.size() < 2 || word.size() > 6) {
+        return std::nullopt;
+    }
+
+    switch (word[0]) {
+    case 'i':
+        if (word == "if"sv) return token_type::If{};
+        break;
+    case 'o':
+        if (word == "or"sv) return token_type::Or{};
+        break;
+    case 'd':
+        if (word == "def"sv) return token_type::Def{};
+        break;
+    case 'a':
+        if (word == "and"sv) return token_type::And{};
+        break;
+    case 'n':
+        if (word == "not"sv) return token_type::Not{};
+        break;
+    case 'e':
+        if (word == "else"sv) return token_type::Else{};
+        break;
+    case 'N':
+        if (word == "None"sv) return token_type::None{};
+        break;
+    case 'T':
+        if (word == "True"sv) return token_type::True{};
+        break;
+    case 'c':
+        if (word == "class"sv) return token_type::Class{};
+        break;
+    case 'p':
+        if (word == "print"sv) return token_type::Print{};
+        break;
+    case 'F':
+        if (word == "False"sv) return token_type::False{};
+        break;
+    case 'r':
+        if (word == "return"sv) return token_type::Return{};
+        break;
+    default:
+        break;
+    }
+    return std::nullopt;
+}
+
+// Состояние отступов: last_ - уровень, до которого уже выданы Indent/Dedent,
+// curr_ - уровень отступа текущей строки
 struct INDENTCONTROL {
     int last_ = 0;
     int curr_ = 0;
@@ -107,15 +163,63 @@ public:
     using std::runtime_error::runtime_error;
 };
 
+// Исходный текст программы, отображённый в память (mmap) только для чтения.
+// На платформах без mmap файл целиком читается в память
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] std::string_view Data() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::string fallback_;
+};
+
 class Lexer {
 public:
-    explicit Lexer(std::istream& input);
+    // STREAMING - лексемы читаются по одной по мере вызовов NextToken.
+    // PIPELINED - лексемы читает отдельный поток и складывает в очередь, NextToken
+    // забирает их оттуда. Поток читается блоками, так что разбор начинается
+    // до того, как вход прочитан целиком
+    enum class Mode {
+        STREAMING,
+        PIPELINED
+    };
+
+    // Считывает поток целиком и разбирает его так же, как непрерывный буфер.
+    // В режиме PIPELINED поток читается блоками по мере разбора и должен
+    // существовать всё время работы лексера
+    explicit Lexer(std::istream& input, Mode mode = Mode::STREAMING);
+
+    // Разбирает буфер source на месте, без копирования.
+    // Буфер должен существовать всё время работы лексера
+    explicit Lexer(std::string_view source, Mode mode = Mode::STREAMING);
+
+    // Выдаёт по порядку уже готовые лексемы из отрезков spans, затем Eof.
+    // Отрезки должны существовать всё время работы лексера
+    explicit Lexer(std::vector<TokenSpan> spans);
+
+    // Останавливает поток чтения лексем в режиме PIPELINED
+    ~Lexer();
+
+    Lexer(const Lexer&) = delete;
+    Lexer& operator=(const Lexer&) = delete;
 
     // Возвращает ссылку на текущий токен или token_type::Eof, если поток токенов закончился
     [[nodiscard]] const Token& CurrentToken() const;
 
     // Возвращает следующий токен, либо token_type::Eof, если поток токенов закончился
-    Token NextToken();
+    const Token& NextToken();
+
+    // Возвращает токен, стоящий через offset позиций после текущего, не сдвигая текущий.
+    // Прочитанные вперёд лексемы запоминаются до вызовов NextToken
+    [[nodiscard]] Token PeekToken(size_t offset = 1);
 
     // Если текущий токен имеет тип T, метод возвращает ссылку на него.
     // В противном случае метод выбрасывает исключение LexerError
@@ -151,10 +255,10 @@ public:
     const T& ExpectNext() {
         using namespace std::literals;
 
-        auto next_token = NextToken();
+        NextToken();
 
-        if (next_token.Is<T>()) {
-            return next_token.As<T>();
+        if (current_token_.Is<T>()) {
+            return current_token_.As<T>();
         }
 
         throw LexerError("Next token type isn't expect"s);
@@ -166,10 +270,10 @@ public:
     void ExpectNext(const U& value) {
         using namespace std::literals;
 
-        auto next_token = NextToken();
+        NextToken();
 
-        if (next_token.Is<T>()) {
-            if (next_token.As<T>().value == value) {
+        if (current_token_.Is<T>()) {
+            if (current_token_.As<T>().value == value) {
                 return;
             }
         }
@@ -178,50 +282,92 @@ public:
     }
 
 private:
-
-    ANSWER IsString();
-    ANSWER IsNumber();
-
-    template<int NUM>
-    ANSWER IsKeyword();
-
-    ANSWER IsId();
-    ANSWER IsDoubleOperation();
-    ANSWER IsChar();
-    ANSWER IsComment();
-    bool IsIndent();
-    ANSWER IsEof();
-    ANSWER IsNewline();
-    ANSWER IndentControl();
-    void ReadNextString();
-    void PrepareForNewTokenReading(size_t pos);
-    token_type::String LoadString(size_t pos);
+    Token ReadToken();
+    Token ScanToken();
+    Token ScanNumber();
+    Token ScanIdOrKeyword();
+    Token ScanString();
+    Token ScanOperation();
+    std::string_view DecodeString(std::string_view literal);
+    bool ReadNextString();
+    bool ReadNextBlock();
+    void StartProducer();
+    void RunProducer();
+    Token FetchToken();
 
     Token current_token_;
     size_t pos_ = 0;
+    bool at_line_start_ = true;
     INDENTCONTROL ident_control_;
-    std::istream& input_stream_;
+    std::string owned_source_;
+    std::string_view source_;
+    size_t next_line_ = 0;
     std::string_view input_string_ = "";
-    std::string in_str_;
-    std::list<ANSWER(Lexer::*)()> LEXEMS_LIST = {};
-    std::vector<std::string> KEYWORDS_NAMES_;
+    // Раскодированные строковые константы с escape-последовательностями
+    std::deque<std::string> decoded_strings_;
+    // Лексемы, прочитанные PeekToken
+    std::deque<Token> lookahead_;
+
+    // Готовые лексемы: отрезки и позиция в текущем отрезке
+    std::vector<TokenSpan> spans_;
+    size_t span_index_ = 0;
+    const Token* span_pos_ = nullptr;
+
+    // Режим PIPELINED: поток, из которого читаются блоки, прочитанные блоки
+    // (в них указывают Id и String) и начало незаконченной строки
+    std::istream* input_ = nullptr;
+    std::deque<std::string> blocks_;
+    std::string partial_line_;
+    // Очередь лексем от потока чтения. Ошибку лексического разбора поток
+    // сохраняет в producer_error_, и она выбрасывается после выдачи прочитанных лексем
+    std::unique_ptr<SpscRing<Token>> queue_;
+    std::exception_ptr producer_error_;
+    std::atomic<bool> producer_done_{false};
+    std::atomic<bool> stop_producer_{false};
+    std::thread producer_;
 };
 
-template<int NUM>
-parse::ANSWER Lexer::IsKeyword() {
-    auto& etalon = KEYWORDS_NAMES_[NUM];
-    if (pos_ == etalon.size()-1) {
-        if (((input_string_.size() - 1 == pos_) || (input_string_[pos_ +1] == ' '))&&(input_string_[pos_] == etalon[pos_])) {
-            PrepareForNewTokenReading(pos_+1);
-            current_token_ = name_to_lexem.at(etalon);
-            return current_token_;
-        }
-        return {};
-    }
-    if (input_string_[pos_] != etalon[pos_]) {
-        return {};
-    }
-    return MAYBE;
-}
+// Лексер для многократного разбора слегка меняющейся программы.
+// Лексемы каждой строки кэшируются по хешу её текста и уровню отступа, с которым
+// строка встретилась. При повторном разборе заново разбираются только изменённые строки
+// и строки, перед которыми изменились Indent/Dedent. Неизменённые строки
+// сравниваются с предыдущей версией программы по порядку, без хеширования
+class IncrementalLexer {
+public:
+    // Разбирает source целиком и возвращает его лексемы отрезками по строкам
+    // (последний отрезок - Dedent до нулевого уровня и Eof).
+    // Результат и строки в нём действительны до следующего вызова Lex
+    const std::vector<TokenSpan>& Lex(std::string_view source);
+
+    // Число строк, разобранных заново (не взятых из кэша) при последнем вызове Lex
+    [[nodiscard]] size_t RelexedLines() const;
+
+private:
+    // Лексемы одной строки: Indent/Dedent от уровня level_in до уровня строки,
+    // сами лексемы строки и Newline. Id и String указывают в text и decoded
+    struct LineRun {
+        std::string text;
+        std::uint64_t hash = 0;
+        int level_in = 0;
+        int level_out = 0;
+        std::vector<std::string> decoded;
+        std::vector<Token> tokens;
+        size_t generation = 0;
+    };
+
+    const LineRun* FindInPreviousLines(std::string_view text, int level_in);
+    const LineRun& FindOrLexLine(std::string_view text, int level_in);
+    void EvictUnusedLines();
+
+    std::unordered_map<std::uint64_t, std::vector<std::unique_ptr<LineRun>>> runs_;
+    // Строки предыдущей и текущей версии программы и позиция в предыдущей
+    std::vector<LineRun*> previous_lines_;
+    std::vector<LineRun*> lines_;
+    size_t previous_cursor_ = 0;
+    std::vector<TokenSpan> spans_;
+    std::vector<Token> tail_;
+    size_t generation_ = 0;
+    size_t relexed_lines_ = 0;
+};
 
 }  // namespace parse
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "lexer.h"
+#include "scan.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+namespace parse {
+
+namespace {
+
+constexpr int RUNS = 5;
+
+// Лучшее время из нескольких запусков, в секундах
+template <typename Fn>
+double BestOf(Fn fn) {
+    double best = 1e9;
+    for (int run = 0; run < RUNS; ++run) {
+        const auto start = chrono::steady_clock::now();
+        fn();
+        const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+// Глубоко вложенные блоки: большая часть входа - ведущие пробелы, комментарии и пустые строки
+string MakeIndentHeavyCorpus() {
+    string source;
+    for (int block = 0; block < 400; ++block) {
+        for (int depth = 0; depth < 40; ++depth) {
+            source.append(depth * 2, ' ').append("if x:\n"s);
+            source.append(depth * 2 + 2, ' ').append("# comment at this level\n\n"s);
+        }
+        source.append(80, ' ').append("x = x + 1\n"s);
+    }
+    return source;
+}
+
+// Длинные строковые литералы с редкими escape-последовательностями
+string MakeStringHeavyCorpus() {
+    string source;
+    const string body(240, 'a');
+    for (int line = 0; line < 20000; ++line) {
+        source.append("s = '"s).append(body).append("\\t"s).append(body).append("'\n"s);
+        source.append("t = \""s).append(body).append("\"\n"s);
+    }
+    return source;
+}
+
+size_t LexAll(string_view source) {
+    Lexer lexer(source);
+    size_t tokens = 1;
+    while (!lexer.CurrentToken().Is<token_type::Eof>()) {
+        lexer.NextToken();
+        ++tokens;
+    }
+    return tokens;
+}
+
+// Посимвольные циклы, которыми лексер пользовался до векторных примитивов
+size_t NaiveFirstNonSpace(string_view text) {
+    size_t i = 0;
+    while (i < text.size() && text[i] == ' ') {
+        ++i;
+    }
+    return i;
+}
+
+size_t NaiveStringEnd(string_view text, char quote) {
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == quote || text[i] == '\\' || text[i] == '\n' || text[i] == '\r') {
+            return i;
+        }
+    }
+    return text.size();
+}
+
+size_t NaiveLineEnd(string_view text) {
+    const size_t pos = text.find('\n');
+    return pos == string_view::npos ? text.size() : pos;
+}
+
+// Проходит вход так же, как лексер: строка за строкой, отступ, затем тела строковых литералов.
+// Возвращает контрольную сумму, чтобы компилятор не выбросил цикл
+template <typename LineEnd, typename FirstNonSpace, typename StringEnd>
+size_t Scan(string_view source, LineEnd line_end, FirstNonSpace first_non_space,
+            StringEnd string_end) {
+    size_t checksum = 0;
+    while (!source.empty()) {
+        const size_t end = line_end(source);
+        string_view line = source.substr(0, end);
+        const size_t indent = first_non_space(line);
+        checksum += indent;
+        for (size_t pos = indent; pos < line.size(); ++pos) {
+            const char ch = line[pos];
+            if (ch != '\'' && ch != '"') {
+                continue;
+            }
+            while (++pos < line.size()) {
+                pos += string_end(line.substr(pos), ch);
+                if (pos >= line.size() || line[pos] != '\\') {
+                    break;
+                }
+                ++pos;
+            }
+            checksum += pos;
+        }
+        source.remove_prefix(min(end + 1, source.size()));
+    }
+    return checksum;
+}
+
+void BenchCorpus(ostream& out, string_view name, const string& source) {
+    const double megabytes = static_cast<double>(source.size()) / (1024 * 1024);
+    size_t tokens = 0;
+    const double lex_time = BestOf([&] {
+        tokens = LexAll(source);
+    });
+
+    size_t naive_sum = 0;
+    const double naive_time = BestOf([&] {
+        naive_sum = Scan(source, NaiveLineEnd, NaiveFirstNonSpace, NaiveStringEnd);
+    });
+    size_t kernel_sum = 0;
+    const double kernel_time = BestOf([&] {
+        kernel_sum = Scan(source, scan::FindLineEnd, scan::FindFirstNonSpace, scan::FindStringEnd);
+    });
+    if (naive_sum != kernel_sum) {
+        out << name << ": scan checksum mismatch"sv << endl;
+        return;
+    }
+
+    out << fixed << setprecision(1);
+    out << name << ": "sv << megabytes << " MB, "sv << tokens << " tokens, lexer "sv
+        << megabytes / lex_time << " MB/s; scan scalar "sv << megabytes / naive_time
+        << " MB/s, "sv << scan::ActiveKernelName() << ' ' << megabytes / kernel_time
+        << " MB/s (x"sv << setprecision(2) << naive_time / kernel_time << ')' << endl;
+}
+
+}  // namespace
+
+void RunLexerBenchmarks(ostream& out) {
+    BenchCorpus(out, "indentation-heavy"sv, MakeIndentHeavyCorpus());
+    BenchCorpus(out, "string-heavy"sv, MakeStringHeavyCorpus());
+}
+
+}  // namespace parse
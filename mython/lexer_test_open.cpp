@@ -1,4 +1,5 @@
 #include "lexer.h"
+#include "scan.h"
 #include "test_runner.h"
 
 #include <sstream>
@@ -351,6 +352,260 @@ abc#
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
     }
 }
+
+void TestBufferInput() {
+    const string source = "x = 'a'\nif x:\n  print x # comment\n\n"s;
+    Lexer lexer(string_view{source});
+
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"a"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::If{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Print{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+
+    istringstream is(source);
+    Lexer stream_lexer(is);
+    Lexer buffer_lexer(string_view{source});
+    ASSERT_EQUAL(stream_lexer.CurrentToken(), buffer_lexer.CurrentToken());
+    while (!buffer_lexer.CurrentToken().Is<token_type::Eof>()) {
+        ASSERT_EQUAL(stream_lexer.NextToken(), buffer_lexer.NextToken());
+    }
+}
+
+void TestTokensPointIntoSource() {
+    const string source = R"(name = 'plain' + "esc\"aped\n")"s;
+    Lexer lexer(string_view{source});
+
+    const auto& id = lexer.Expect<token_type::Id>();
+    ASSERT_EQUAL(id.value, "name"s);
+    ASSERT(id.value.data() == source.data());
+
+    lexer.NextToken();
+    const auto& plain = lexer.ExpectNext<token_type::String>();
+    ASSERT_EQUAL(plain.value, "plain"s);
+    ASSERT(plain.value.data() == source.data() + source.find("plain"s));
+
+    lexer.NextToken();
+    ASSERT_EQUAL(lexer.ExpectNext<token_type::String>().value, "esc\"aped\n"s);
+}
+
+static_assert(FindKeyword("class"sv).has_value());
+static_assert(!FindKeyword("Class"sv).has_value());
+
+void TestKeywordTable() {
+    ASSERT_EQUAL(*FindKeyword("class"sv), Token(token_type::Class{}));
+    ASSERT_EQUAL(*FindKeyword("return"sv), Token(token_type::Return{}));
+    ASSERT_EQUAL(*FindKeyword("if"sv), Token(token_type::If{}));
+    ASSERT_EQUAL(*FindKeyword("else"sv), Token(token_type::Else{}));
+    ASSERT_EQUAL(*FindKeyword("def"sv), Token(token_type::Def{}));
+    ASSERT_EQUAL(*FindKeyword("print"sv), Token(token_type::Print{}));
+    ASSERT_EQUAL(*FindKeyword("and"sv), Token(token_type::And{}));
+    ASSERT_EQUAL(*FindKeyword("or"sv), Token(token_type::Or{}));
+    ASSERT_EQUAL(*FindKeyword("not"sv), Token(token_type::Not{}));
+    ASSERT_EQUAL(*FindKeyword("None"sv), Token(token_type::None{}));
+    ASSERT_EQUAL(*FindKeyword("True"sv), Token(token_type::True{}));
+    ASSERT_EQUAL(*FindKeyword("False"sv), Token(token_type::False{}));
+
+    for (const auto word : {""sv, "i"sv, "iff"sv, "els"sv, "elsewhere"sv, "none"sv, "true"sv,
+                            "returns"sv, "print_"sv, "_class"sv, "x"sv}) {
+        ASSERT(!FindKeyword(word).has_value());
+    }
+}
+
+void TestScanKernels() {
+    // Длины от 0 до 100 покрывают векторную часть, остаток и скалярную версию
+    for (size_t size = 0; size <= 100; ++size) {
+        for (size_t hit = 0; hit <= size; ++hit) {
+            string text(size, ' ');
+            if (hit < size) {
+                text[hit] = 'x';
+            }
+            ASSERT_EQUAL(scan::FindFirstNonSpace(text), hit);
+
+            string line(size, 'a');
+            string body(size, 'b');
+            if (hit < size) {
+                line[hit] = '\n';
+                body[hit] = "'\\\n\r"[hit % 4];
+            }
+            ASSERT_EQUAL(scan::FindLineEnd(line), hit);
+            ASSERT_EQUAL(scan::FindStringEnd(body, '\''), hit);
+            ASSERT_EQUAL(scan::FindStringEnd(body, '"'), hit % 4 == 0 ? size : hit);
+        }
+    }
+}
+
+void TestPeekToken() {
+    const string source = "x.y = 1\n"s;
+    for (const auto mode : {Lexer::Mode::STREAMING, Lexer::Mode::PIPELINED}) {
+        Lexer lexer(string_view{source}, mode);
+        ASSERT_EQUAL(lexer.PeekToken(0), Token(token_type::Id{"x"s}));
+        ASSERT_EQUAL(lexer.PeekToken(3), Token(token_type::Char{'='}));
+        ASSERT_EQUAL(lexer.PeekToken(), Token(token_type::Char{'.'}));
+        ASSERT_EQUAL(lexer.PeekToken(100), Token(token_type::Eof{}));
+        ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+        ASSERT_EQUAL(lexer.PeekToken(2), Token(token_type::Number{1}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{1}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+        ASSERT_EQUAL(lexer.PeekToken(), Token(token_type::Eof{}));
+    }
+}
+
+void TestPipelinedLexer() {
+    // Программа больше блока чтения и очереди лексем, с длинной строкой посередине
+    string source;
+    for (int i = 0; i < 3000; ++i) {
+        source += "class C"s + to_string(i) + ":\n  def f(self):\n    return 'x' + \"y\\n\"  # c\n\n"s;
+        if (i == 1500) {
+            source += "s = '"s + string(100000, 'z') + "'\n"s;
+        }
+    }
+    source += "print 1"s;
+
+    Lexer expected(string_view{source});
+    istringstream stream_input(source);
+    Lexer from_stream(stream_input, Lexer::Mode::PIPELINED);
+    Lexer from_buffer(string_view{source}, Lexer::Mode::PIPELINED);
+
+    ASSERT_EQUAL(from_stream.CurrentToken(), expected.CurrentToken());
+    ASSERT_EQUAL(from_buffer.CurrentToken(), expected.CurrentToken());
+    while (!expected.CurrentToken().Is<token_type::Eof>()) {
+        ASSERT_EQUAL(from_stream.PeekToken(2), expected.PeekToken(2));
+        const Token& token = expected.NextToken();
+        ASSERT_EQUAL(from_stream.NextToken(), token);
+        ASSERT_EQUAL(from_buffer.NextToken(), token);
+    }
+    ASSERT_EQUAL(from_stream.NextToken(), Token(token_type::Eof{}));
+    ASSERT_EQUAL(from_buffer.NextToken(), Token(token_type::Eof{}));
+}
+
+void TestPipelinedLexerErrors() {
+    // Ошибка выбрасывается на той же лексеме, что и в обычном режиме
+    istringstream input("x = 1\ny = 'unterminated\n"s);
+    Lexer lexer(input, Lexer::Mode::PIPELINED);
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{1}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+    try {
+        lexer.NextToken();
+        ASSERT(false);
+    } catch (const LexerError&) {
+    }
+
+    try {
+        istringstream bad_start("'"s);
+        Lexer bad_lexer(bad_start, Lexer::Mode::PIPELINED);
+        ASSERT(false);
+    } catch (const LexerError&) {
+    }
+
+    // Лексер, брошенный на середине, останавливает поток чтения
+    const string long_source(1'000'000, '\n');
+    string program = "x = 1\n"s + long_source + "y = 2\n"s;
+    Lexer abandoned(string_view{program}, Lexer::Mode::PIPELINED);
+    ASSERT_EQUAL(abandoned.CurrentToken(), Token(token_type::Id{"x"s}));
+}
+
+void AssertSameTokens(const vector<TokenSpan>& spans, const string& source) {
+    Lexer expected(string_view{source});
+    for (const TokenSpan& span : spans) {
+        for (const Token* token = span.begin; token != span.end; ++token, expected.NextToken()) {
+            ASSERT_EQUAL(*token, expected.CurrentToken());
+        }
+    }
+    ASSERT(spans.back().end[-1].Is<token_type::Eof>());
+}
+
+void TestIncrementalLexer() {
+    vector<string> lines = {
+        "class Counter:"s,
+        "  def __init__():"s,
+        "    self.value = 0"s,
+        ""s,
+        "  def add():"s,
+        "    # комментарий"s,
+        "    self.value = self.value + 1"s,
+        "    print 'added\\n'"s,
+        ""s,
+        "x = Counter()"s,
+        "x.add()"s,
+        "print x.value"s,
+    };
+    auto join = [&lines] {
+        string result;
+        for (const string& line : lines) {
+            result += line + "\n"s;
+        }
+        return result;
+    };
+
+    IncrementalLexer lexer;
+    string source = join();
+    AssertSameTokens(lexer.Lex(source), source);
+    ASSERT_EQUAL(lexer.RelexedLines(), 9u);
+
+    // Повторный разбор той же программы целиком берётся из кэша
+    source = join();
+    AssertSameTokens(lexer.Lex(source), source);
+    ASSERT_EQUAL(lexer.RelexedLines(), 0u);
+
+    // Изменение одной строки
+    lines[6] = "    self.value = self.value + 2"s;
+    source = join();
+    AssertSameTokens(lexer.Lex(source), source);
+    ASSERT_EQUAL(lexer.RelexedLines(), 1u);
+
+    // Новая строка с другим отступом меняет Indent/Dedent перед следующей строкой
+    lines.insert(lines.begin() + 3, "    if self.value > 1:"s);
+    lines.insert(lines.begin() + 4, "      print 'big'"s);
+    source = join();
+    const vector<TokenSpan>& spans = lexer.Lex(source);
+    AssertSameTokens(spans, source);
+    ASSERT_EQUAL(lexer.RelexedLines(), 3u);
+
+    // Удаление строк
+    lines.erase(lines.begin() + 3, lines.begin() + 5);
+    source = join();
+    AssertSameTokens(lexer.Lex(source), source);
+    ASSERT_EQUAL(lexer.RelexedLines(), 1u);
+
+    // Ошибка в строке сбрасывает кэш, но не ломает следующий разбор
+    try {
+        lexer.Lex("x = 'unterminated\n"s);
+        ASSERT(false);
+    } catch (const LexerError&) {
+    }
+    source = join();
+    AssertSameTokens(lexer.Lex(source), source);
+    ASSERT_EQUAL(lexer.RelexedLines(), 9u);
+
+    // Разобранные лексемы можно передать обычному лексеру
+    Lexer from_buffer(lexer.Lex(source));
+    Lexer expected(string_view{source});
+    while (!expected.CurrentToken().Is<token_type::Eof>()) {
+        ASSERT_EQUAL(from_buffer.CurrentToken(), expected.CurrentToken());
+        from_buffer.NextToken();
+        expected.NextToken();
+    }
+    ASSERT(from_buffer.CurrentToken().Is<token_type::Eof>());
+}
 }  // namespace
 
 void RunOpenLexerTests(TestRunner& tr) {
@@ -367,6 +622,14 @@ void RunOpenLexerTests(TestRunner& tr) {
     RUN_TEST(tr, parse::TestMythonProgram);
     RUN_TEST(tr, parse::TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine);
     RUN_TEST(tr, parse::TestCommentsAreIgnored);
+    RUN_TEST(tr, parse::TestBufferInput);
+    RUN_TEST(tr, parse::TestTokensPointIntoSource);
+    RUN_TEST(tr, parse::TestKeywordTable);
+    RUN_TEST(tr, parse::TestScanKernels);
+    RUN_TEST(tr, parse::TestPeekToken);
+    RUN_TEST(tr, parse::TestPipelinedLexer);
+    RUN_TEST(tr, parse::TestPipelinedLexerErrors);
+    RUN_TEST(tr, parse::TestIncrementalLexer);
 }
 
 }  // namespace parse
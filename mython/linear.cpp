@@ -0,0 +1,654 @@
+#include "linear.h"
+
+#include <array>
+#include <typeinfo>
+#include <unordered_map>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MYTHON_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define MYTHON_NOINLINE __declspec(noinline)
+#else
+#define MYTHON_NOINLINE
+#endif
+
+using namespace std;
+
+namespace ast {
+
+using runtime::Closure;
+using runtime::Context;
+using runtime::ObjectHolder;
+
+namespace {
+[[noreturn]] MYTHON_NOINLINE void ThrowUndefinedVariable() {
+    throw runtime_error("VariableValue fail"s);
+}
+
+ObjectHolder LookUp(const Closure& closure, const string& name) {
+    if (auto it = closure.find(name); it != closure.end()) {
+        return it->second;
+    }
+    ThrowUndefinedVariable();
+}
+
+// Кадры методов такого размера размещаются на стеке
+constexpr uint32_t INLINE_FRAME_SIZE = 8;
+
+runtime::ClassInstance& AsInstance(const ObjectHolder& object, const char* error) {
+    auto* instance = object.TryAs<runtime::ClassInstance>();
+    if (instance == nullptr) {
+        throw runtime_error(error);
+    }
+    return *instance;
+}
+
+void PrintValue(const ObjectHolder& object, ostream& os, Context& context) {
+    if (!object) {
+        os << "None"sv;
+    } else {
+        object->Print(os, context);
+    }
+}
+}  // namespace
+
+class Linearizer {
+public:
+    using Op = LinearCode::Op;
+
+    explicit Linearizer(LinearCode& code)
+        : code_(code) {
+    }
+
+    // Тело метода: self и параметры занимают первые ячейки кадра
+    Linearizer(LinearCode& code, const vector<string>& formal_params)
+        : code_(code)
+        , method_(true) {
+        Slot("self"s);
+        for (const auto& param : formal_params) {
+            code_.param_slots_.push_back(Slot(param));
+        }
+    }
+
+    void Build(unique_ptr<Statement>& statement) {
+        code_.root_ = Lower(statement);
+        if (method_ && !needs_closure_) {
+            code_.frame_size_ = static_cast<uint32_t>(slots_.size());
+        } else {
+            code_.param_slots_.clear();
+        }
+    }
+
+private:
+    uint32_t Lower(unique_ptr<Statement>& statement) {
+        if (!statement) {
+            return LinearCode::NO_NODE;
+        }
+        Statement& node = *statement;
+        const type_info& type = typeid(node);
+
+        if (type == typeid(VariableValue)) {
+            return LowerVariable(static_cast<VariableValue&>(node));
+        }
+        if (type == typeid(NumericConst)) {
+            return LowerConstant(static_cast<NumericConst&>(node));
+        }
+        if (type == typeid(StringConst)) {
+            return LowerConstant(static_cast<StringConst&>(node));
+        }
+        if (type == typeid(BoolConst)) {
+            return LowerConstant(static_cast<BoolConst&>(node));
+        }
+        if (type == typeid(MethodCall)) {
+            auto& call = static_cast<MethodCall&>(node);
+            const uint32_t args = LowerList(call.GetArgs());
+            const uint32_t object = Lower(call.GetObject());
+            const auto site = static_cast<uint32_t>(code_.call_sites_.size());
+            code_.call_sites_.push_back({call.GetMethodId(), {}});
+            return Push({Op::METHOD_CALL, object, site, args});
+        }
+        if (type == typeid(Assignment)) {
+            auto& assignment = static_cast<Assignment&>(node);
+            const uint32_t value = Lower(assignment.GetValue());
+            const string& name = assignment.GetName();
+            return Push({Op::ASSIGNMENT, Name(name), value, Slot(name)});
+        }
+        if (type == typeid(FieldAssignment)) {
+            auto& assignment = static_cast<FieldAssignment&>(node);
+            const uint32_t object = LowerVariable(assignment.GetObject());
+            const uint32_t value = Lower(assignment.GetValue());
+            return Push({Op::FIELD_ASSIGNMENT, object, Field(assignment.GetFieldName()), value});
+        }
+        if (type == typeid(Compound)) {
+            return Push({Op::COMPOUND, LowerList(static_cast<Compound&>(node).GetStatements())});
+        }
+        if (type == typeid(Add)) {
+            return LowerBinary<Op::ADD>(static_cast<BinaryOperation&>(node));
+        }
+        if (type == typeid(Sub)) {
+            return LowerBinary<Op::SUB>(static_cast<BinaryOperation&>(node));
+        }
+        if (type == typeid(Mult)) {
+            return LowerBinary<Op::MULT>(static_cast<BinaryOperation&>(node));
+        }
+        if (type == typeid(Div)) {
+            return LowerBinary<Op::DIV>(static_cast<BinaryOperation&>(node));
+        }
+        if (type == typeid(Or)) {
+            return LowerBinary<Op::OR>(static_cast<BinaryOperation&>(node));
+        }
+        if (type == typeid(And)) {
+            return LowerBinary<Op::AND>(static_cast<BinaryOperation&>(node));
+        }
+        if (type == typeid(Comparison)) {
+            auto& comparison = static_cast<Comparison&>(node);
+            const uint32_t index = LowerBinary<Op::COMPARISON>(comparison);
+            code_.nodes_[index].c = static_cast<uint32_t>(code_.comparators_.size());
+            code_.comparators_.push_back(comparison.GetComparator());
+            return index;
+        }
+        if (type == typeid(Not)) {
+            return LowerUnary<Op::NOT>(static_cast<UnaryOperation&>(node));
+        }
+        if (type == typeid(Negate)) {
+            return LowerUnary<Op::NEGATE>(static_cast<UnaryOperation&>(node));
+        }
+        if (type == typeid(Stringify)) {
+            return LowerUnary<Op::STRINGIFY>(static_cast<UnaryOperation&>(node));
+        }
+        if (type == typeid(IfElse)) {
+            auto& if_else = static_cast<IfElse&>(node);
+            const uint32_t condition = Lower(if_else.GetCondition());
+            const uint32_t if_body = Lower(if_else.GetIfBody());
+            const uint32_t else_body = Lower(if_else.GetElseBody());
+            return Push({Op::IF_ELSE, condition, if_body, else_body});
+        }
+        if (type == typeid(Return)) {
+            return Push({Op::RETURN, Lower(static_cast<Return&>(node).GetStatement())});
+        }
+        if (type == typeid(Print)) {
+            return LowerPrint(static_cast<Print&>(node));
+        }
+        if (type == typeid(NewInstance)) {
+            auto& instance = static_cast<NewInstance&>(node);
+            const uint32_t args = LowerList(instance.GetArgs());
+            const auto cls = static_cast<uint32_t>(code_.classes_.size());
+            code_.classes_.push_back(&instance.GetClass());
+            code_.init_caches_.emplace_back();
+            return Push({Op::NEW_INSTANCE, cls, args});
+        }
+        if (type == typeid(MethodBody)) {
+            return Push({Op::METHOD_BODY, Lower(static_cast<MethodBody&>(node).GetBody())});
+        }
+        if (type == typeid(None)) {
+            return Push({Op::NONE});
+        }
+        if (type == typeid(ClassDefinition)) {
+            auto& definition = static_cast<ClassDefinition&>(node);
+            const string& name = definition.GetClass().TryAs<runtime::Class>()->GetName();
+            needs_closure_ = true;
+            return Push({Op::CLASS_DEFINITION, Object(definition.GetClass()), Name(name)});
+        }
+
+        const auto index = static_cast<uint32_t>(code_.opaque_.size());
+        code_.opaque_.push_back(std::move(statement));
+        needs_closure_ = true;
+        return Push({Op::OPAQUE, index});
+    }
+
+    uint32_t Push(LinearCode::Node node) {
+        code_.nodes_.push_back(node);
+        return static_cast<uint32_t>(code_.nodes_.size() - 1);
+    }
+
+    uint32_t Name(const string& name) {
+        auto [it, inserted] = names_.try_emplace(name, static_cast<uint32_t>(code_.names_.size()));
+        if (inserted) {
+            code_.names_.push_back(name);
+        }
+        return it->second;
+    }
+
+    uint32_t Field(const string& name) {
+        code_.field_sites_.push_back({Name(name), {}});
+        return static_cast<uint32_t>(code_.field_sites_.size() - 1);
+    }
+
+    uint32_t Object(ObjectHolder object) {
+        code_.objects_.push_back(std::move(object));
+        return static_cast<uint32_t>(code_.objects_.size() - 1);
+    }
+
+    // Потомки выкладываются подряд, затем в lists_ записываются их индексы
+    uint32_t LowerList(vector<unique_ptr<Statement>>& statements) {
+        vector<uint32_t> items;
+        items.reserve(statements.size());
+        for (auto& statement : statements) {
+            items.push_back(Lower(statement));
+        }
+        const auto list = static_cast<uint32_t>(code_.lists_.size());
+        code_.lists_.push_back(static_cast<uint32_t>(items.size()));
+        code_.lists_.insert(code_.lists_.end(), items.begin(), items.end());
+        return list;
+    }
+
+    uint32_t LowerVariable(const VariableValue& variable) {
+        const auto& ids = variable.GetDottedIds();
+        if (ids.size() <= 1) {
+            const string& name = variable.GetName();
+            return Push({Op::VARIABLE, Name(name), Slot(name)});
+        }
+        const auto list = static_cast<uint32_t>(code_.lists_.size());
+        code_.lists_.push_back(static_cast<uint32_t>(ids.size()));
+        for (const auto& id : ids) {
+            code_.lists_.push_back(Name(id));
+        }
+        // Поля цепочки получают места обращения подряд, начиная с first_field
+        const auto first_field = static_cast<uint32_t>(code_.field_sites_.size());
+        for (size_t i = 1; i < ids.size(); ++i) {
+            Field(ids[i]);
+        }
+        return Push({Op::FIELD_CHAIN, list, Slot(ids.front()), first_field});
+    }
+
+    template <typename T>
+    uint32_t LowerConstant(ValueStatement<T>& constant) {
+        return Push({Op::CONSTANT, Object(constant.GetHolder())});
+    }
+
+    template <Op op>
+    uint32_t LowerUnary(UnaryOperation& operation) {
+        return Push({op, Lower(operation.GetArgument())});
+    }
+
+    template <Op op>
+    uint32_t LowerBinary(BinaryOperation& operation) {
+        const uint32_t lhs_index = Lower(operation.GetLhs());
+        const uint32_t rhs_index = Lower(operation.GetRhs());
+        return Push({op, lhs_index, rhs_index});
+    }
+
+    uint32_t LowerPrint(Print& print) {
+        if (!print.GetName().empty()) {
+            needs_closure_ = true;
+            return Push({Op::PRINT_VARIABLE, Name(print.GetName())});
+        }
+        if (auto* args = get_if<vector<unique_ptr<Statement>>>(&print.GetArguments())) {
+            return Push({Op::PRINT, LowerList(*args)});
+        }
+        vector<unique_ptr<Statement>> single;
+        if (auto& argument = get<unique_ptr<Statement>>(print.GetArguments())) {
+            single.push_back(std::move(argument));
+        }
+        return Push({Op::PRINT, LowerList(single)});
+    }
+
+    // Номер ячейки кадра для локальной переменной name. Вне метода ячейки не используются
+    uint32_t Slot(const string& name) {
+        if (!method_) {
+            return 0;
+        }
+        return slots_.try_emplace(name, static_cast<uint32_t>(slots_.size())).first->second;
+    }
+
+    LinearCode& code_;
+    unordered_map<string, uint32_t> names_;
+    bool method_ = false;
+    unordered_map<string, uint32_t> slots_;
+    // Тело содержит инструкции, которым нужен Closure, и кадр не используется
+    bool needs_closure_ = false;
+};
+
+// Вычисляет узлы одного LinearCode. Тело метода и его инструкции return лежат в одном
+// LinearCode, поэтому return, как и в дереве, взводит флаг, по которому Compound прекращает
+// выполнение, а MethodBody возвращает значение. Флаг хранится в самом Interpreter,
+// а не в Context.
+// Ошибки выполнения по-прежнему передаются исключениями, а раскрутка стека через
+// функцию с множеством обработчиков очистки обходится дорого, поэтому Eval лишь
+// выбирает операцию, а операции с временными значениями вынесены в отдельные функции.
+// Если задан кадр frame, локальные переменные читаются и пишутся в его ячейки
+class LinearCode::Interpreter {
+public:
+    Interpreter(const LinearCode& code, Closure& closure, Slot* frame, Context& context)
+        : code_(code)
+        , closure_(closure)
+        , frame_(frame)
+        , context_(context) {
+    }
+
+    // Вычисляет код целиком. Return вне тела метода, как и в дереве, завершает выполнение,
+    // и результатом становится его значение
+    ObjectHolder Run(uint32_t root) {
+        ObjectHolder result = Eval(root);
+        if (returning_) {
+            return std::move(returned_);
+        }
+        return result;
+    }
+
+private:
+    ObjectHolder Eval(uint32_t index) {
+        const Node& node = code_.nodes_[index];
+        switch (node.op) {
+            case Op::CONSTANT:
+                return code_.objects_[node.a];
+            case Op::NONE:
+                return ObjectHolder::None();
+            case Op::VARIABLE:
+                if (frame_ != nullptr) {
+                    return ReadSlot(node.b);
+                }
+                return LookUp(closure_, code_.names_[node.a]);
+            case Op::FIELD_CHAIN:
+                return EvalFieldChain(node);
+            case Op::ASSIGNMENT:
+                return EvalAssignment(node);
+            case Op::FIELD_ASSIGNMENT:
+                return EvalFieldAssignment(node);
+            case Op::PRINT_VARIABLE:
+            case Op::PRINT:
+                return EvalPrint(node);
+            case Op::METHOD_CALL:
+                return EvalMethodCall(node);
+            case Op::NEW_INSTANCE:
+                return EvalNewInstance(node);
+            case Op::STRINGIFY:
+                return EvalStringify(node);
+            case Op::ADD:
+                return EvalArithmetic<Add>(node);
+            case Op::SUB:
+                return EvalArithmetic<Sub>(node);
+            case Op::MULT:
+                return EvalArithmetic<Mult>(node);
+            case Op::DIV:
+                return EvalArithmetic<Div>(node);
+            case Op::OR:
+                return EvalOr(node);
+            case Op::AND:
+                return EvalAnd(node);
+            case Op::NOT:
+                return EvalNot(node);
+            case Op::NEGATE:
+                return EvalNegate(node);
+            case Op::COMPARISON:
+                return EvalComparison(node);
+            case Op::COMPOUND:
+                return EvalCompound(node);
+            case Op::RETURN:
+                return EvalReturn(node);
+            case Op::CLASS_DEFINITION:
+                closure_[code_.names_[node.b]] = code_.objects_[node.a];
+                return code_.objects_[node.a];
+            case Op::IF_ELSE:
+                return EvalIfElse(node);
+            case Op::METHOD_BODY:
+                return EvalMethodBody(node);
+            case Op::OPAQUE:
+                return code_.opaque_[node.a]->Execute(closure_, context_);
+        }
+        return ObjectHolder::None();
+    }
+
+    const ObjectHolder& ReadSlot(uint32_t slot) const {
+        if (!frame_[slot]) {
+            ThrowUndefinedVariable();
+        }
+        return *frame_[slot];
+    }
+
+    vector<ObjectHolder> EvalList(uint32_t list) {
+        const uint32_t count = code_.lists_[list];
+        vector<ObjectHolder> values;
+        values.reserve(count);
+        for (uint32_t i = 1; i <= count; ++i) {
+            values.push_back(Eval(code_.lists_[list + i]));
+        }
+        return values;
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalFieldChain(const Node& node) {
+        const uint32_t count = code_.lists_[node.a];
+        const ObjectHolder& first =
+            frame_ != nullptr ? ReadSlot(node.b) : closure_[code_.names_[code_.lists_[node.a + 1]]];
+        runtime::FieldTable* fields = &AsInstance(first, "VariableValue fail").Fields();
+        FieldSite* site = &code_.field_sites_[node.c];
+        for (uint32_t i = 2; i < count; ++i, ++site) {
+            const ObjectHolder& object = site->cache.Insert(*fields, code_.names_[site->name]);
+            fields = &AsInstance(object, "VariableValue fail").Fields();
+        }
+        const ObjectHolder* field = site->cache.Find(*fields, code_.names_[site->name]);
+        if (field == nullptr) {
+            ThrowUndefinedVariable();
+        }
+        return *field;
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalAssignment(const Node& node) {
+        ObjectHolder value = Eval(node.b);
+        if (frame_ != nullptr) {
+            frame_[node.c] = value;
+        } else {
+            closure_[code_.names_[node.a]] = value;
+        }
+        return value;
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalFieldAssignment(const Node& node) {
+        const ObjectHolder object = Eval(node.a);
+        runtime::FieldTable& fields = AsInstance(object, "FieldAssignment fail").Fields();
+        ObjectHolder value = Eval(node.c);
+        FieldSite& site = code_.field_sites_[node.b];
+        site.cache.Insert(fields, code_.names_[site.name]) = value;
+        return value;
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalPrint(const Node& node) {
+        ostream& os = context_.GetOutputStream();
+        if (node.op == Op::PRINT_VARIABLE) {
+            PrintValue(closure_[code_.names_[node.a]], os, context_);
+        } else {
+            const uint32_t count = code_.lists_[node.a];
+            for (uint32_t i = 1; i <= count; ++i) {
+                if (i > 1) {
+                    os << " "sv;
+                }
+                PrintValue(Eval(code_.lists_[node.a + i]), os, context_);
+            }
+        }
+        os << endl;
+        return ObjectHolder::None();
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalMethodCall(const Node& node) {
+        const vector<ObjectHolder> args = EvalList(node.c);
+        const ObjectHolder object = Eval(node.a);
+        auto& instance = AsInstance(object, "MethodCall fail");
+        CallSite& site = code_.call_sites_[node.b];
+        const runtime::Method* method =
+            site.cache.Find(instance.GetClass(), site.method, args.size());
+        return instance.Call(method, args, context_);
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalNewInstance(const Node& node) {
+        const runtime::Class& cls = *code_.classes_[node.a];
+        auto result = ObjectHolder::Own(runtime::ClassInstance(cls));
+        const runtime::Method* init =
+            code_.init_caches_[node.a].Find(cls, runtime::INIT_METHOD_ID, code_.lists_[node.b]);
+        if (init != nullptr) {
+            result.TryAs<runtime::ClassInstance>()->Call(init, EvalList(node.b), context_);
+        }
+        return result;
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalStringify(const Node& node) {
+        return Stringify::Apply(Eval(node.a), context_);
+    }
+
+    template <typename Operation>
+    MYTHON_NOINLINE ObjectHolder EvalArithmetic(const Node& node) {
+        const ObjectHolder lhs = Eval(node.a);
+        const ObjectHolder rhs = Eval(node.b);
+        return Operation::Apply(lhs, rhs, context_);
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalOr(const Node& node) {
+        const ObjectHolder lhs = Eval(node.a);
+        if (auto* value = lhs.TryAs<runtime::Bool>(); value != nullptr && value->GetValue()) {
+            return ObjectHolder::Own(runtime::Bool(true));
+        }
+        const ObjectHolder rhs = Eval(node.b);
+        if (auto* value = rhs.TryAs<runtime::Bool>()) {
+            return ObjectHolder::Own(runtime::Bool(value->GetValue()));
+        }
+        throw runtime_error("Or method fail"s);
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalAnd(const Node& node) {
+        const ObjectHolder lhs = Eval(node.a);
+        auto* lhs_value = lhs.TryAs<runtime::Bool>();
+        if (lhs_value != nullptr && !lhs_value->GetValue()) {
+            return ObjectHolder::Own(runtime::Bool(false));
+        }
+        const ObjectHolder rhs = Eval(node.b);
+        if (auto* value = rhs.TryAs<runtime::Bool>(); value != nullptr && lhs_value != nullptr) {
+            return ObjectHolder::Own(runtime::Bool(value->GetValue()));
+        }
+        throw runtime_error("And method fail"s);
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalNot(const Node& node) {
+        return Not::Apply(Eval(node.a));
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalNegate(const Node& node) {
+        return Negate::Apply(Eval(node.a));
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalComparison(const Node& node) {
+        const ObjectHolder lhs = Eval(node.a);
+        const ObjectHolder rhs = Eval(node.b);
+        return ObjectHolder::Own(runtime::Bool(code_.comparators_[node.c](lhs, rhs, context_)));
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalCompound(const Node& node) {
+        const uint32_t count = code_.lists_[node.a];
+        for (uint32_t i = 1; i <= count; ++i) {
+            Eval(code_.lists_[node.a + i]);
+            if (returning_) {
+                break;
+            }
+        }
+        return ObjectHolder::None();
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalReturn(const Node& node) {
+        returned_ = Eval(node.a);
+        returned_.Retain();
+        returning_ = true;
+        return ObjectHolder::None();
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalIfElse(const Node& node) {
+        const ObjectHolder condition = Eval(node.a);
+        auto* value = condition.TryAs<runtime::Bool>();
+        if (value == nullptr) {
+            throw runtime_error("IfElse fail"s);
+        }
+        if (value->GetValue()) {
+            return Eval(node.b);
+        }
+        return node.c == NO_NODE ? ObjectHolder::None() : Eval(node.c);
+    }
+
+    MYTHON_NOINLINE ObjectHolder EvalMethodBody(const Node& node) {
+        Eval(node.a);
+        if (returning_) {
+            returning_ = false;
+            return std::move(returned_);
+        }
+        return ObjectHolder::None();
+    }
+
+    const LinearCode& code_;
+    Closure& closure_;
+    Slot* frame_;
+    Context& context_;
+    bool returning_ = false;
+    ObjectHolder returned_;
+};
+
+ObjectHolder LinearCode::Execute(Closure& closure, Context& context) {
+    if (root_ == NO_NODE) {
+        return ObjectHolder::None();
+    }
+    return Interpreter{*this, closure, nullptr, context}.Run(root_);
+}
+
+ObjectHolder LinearCode::ExecuteMethod(const vector<string>& formal_params,
+                                       const ObjectHolder& self,
+                                       const vector<ObjectHolder>& actual_args,
+                                       Context& context) {
+    if (frame_size_ == 0) {
+        return Executable::ExecuteMethod(formal_params, self, actual_args, context);
+    }
+
+    array<Slot, INLINE_FRAME_SIZE> inline_frame;
+    vector<Slot> heap_frame;
+    Slot* frame = inline_frame.data();
+    if (frame_size_ > INLINE_FRAME_SIZE) {
+        heap_frame.resize(frame_size_);
+        frame = heap_frame.data();
+    }
+    frame[0] = self;
+    for (size_t i = 0; i < actual_args.size(); ++i) {
+        frame[param_slots_[i]] = actual_args[i];
+    }
+
+    Closure unused;
+    return Interpreter{*this, unused, frame, context}.Run(root_);
+}
+
+size_t LinearCode::Size() const {
+    return nodes_.size();
+}
+
+size_t LinearCode::FrameSize() const {
+    return frame_size_;
+}
+
+size_t LinearCode::CacheHits() const {
+    size_t hits = 0;
+    for (const auto& site : call_sites_) {
+        hits += site.cache.Hits();
+    }
+    for (const auto& cache : init_caches_) {
+        hits += cache.Hits();
+    }
+    return hits;
+}
+
+size_t LinearCode::CacheMisses() const {
+    size_t misses = 0;
+    for (const auto& site : call_sites_) {
+        misses += site.cache.Misses();
+    }
+    for (const auto& cache : init_caches_) {
+        misses += cache.Misses();
+    }
+    return misses;
+}
+
+unique_ptr<LinearCode> Linearize(unique_ptr<Statement> statement) {
+    auto code = make_unique<LinearCode>();
+    Linearizer{*code}.Build(statement);
+    return code;
+}
+
+unique_ptr<LinearCode> LinearizeMethod(unique_ptr<Statement> body,
+                                       const vector<string>& formal_params) {
+    auto code = make_unique<LinearCode>();
+    Linearizer{*code, formal_params}.Build(body);
+    return code;
+}
+
+}  // namespace ast
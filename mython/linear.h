@@ -0,0 +1,133 @@
+#pragma once
+
+#include "statement.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ast {
+
+/*
+Линейное представление дерева инструкций.
+Узлы лежат в одном массиве в порядке обратного обхода (потомки раньше родителя),
+а на потомков ссылаются 32-битными индексами. Операнды бинарной операции
+и инструкции составного блока оказываются рядом в памяти, а вычисление идёт
+одним switch без виртуальных вызовов и переходов по разбросанным в куче узлам.
+Инструкции, тип которых линейное представление не знает, выполняются через Execute.
+
+В теле метода все имена переменных локальны: self, параметры и присвоенные в методе имена.
+Каждое получает номер ячейки в кадре метода, и при вызове через ExecuteMethod
+переменные хранятся в массиве, а не в Closure. Код верхнего уровня и тела, которым нужен
+настоящий Closure (неизвестные инструкции, объявления классов), ищут переменные по имени
+*/
+class LinearCode : public Statement {
+public:
+    // Выполняет код. Результат и вывод совпадают с исходным деревом
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    runtime::ObjectHolder ExecuteMethod(const std::vector<std::string>& formal_params,
+                                       const runtime::ObjectHolder& self,
+                                       const std::vector<runtime::ObjectHolder>& actual_args,
+                                       runtime::Context& context) override;
+
+    // Возвращает число ячеек в кадре метода либо 0, если переменные ищутся по имени
+    [[nodiscard]] size_t FrameSize() const;
+
+    // Возвращает число узлов
+    [[nodiscard]] size_t Size() const;
+
+    // Суммы попаданий и промахов встроенных кэшей всех вызовов методов и конструкторов
+    [[nodiscard]] size_t CacheHits() const;
+    [[nodiscard]] size_t CacheMisses() const;
+
+private:
+    friend class Linearizer;
+
+    enum class Op : std::uint8_t {
+        CONSTANT,
+        NONE,
+        VARIABLE,
+        FIELD_CHAIN,
+        ASSIGNMENT,
+        FIELD_ASSIGNMENT,
+        PRINT_VARIABLE,
+        PRINT,
+        METHOD_CALL,
+        NEW_INSTANCE,
+        STRINGIFY,
+        ADD,
+        SUB,
+        MULT,
+        DIV,
+        OR,
+        AND,
+        NOT,
+        NEGATE,
+        COMPARISON,
+        COMPOUND,
+        RETURN,
+        CLASS_DEFINITION,
+        IF_ELSE,
+        METHOD_BODY,
+        OPAQUE,
+    };
+
+    // Отсутствующий потомок (например, ветка else)
+    static constexpr std::uint32_t NO_NODE = UINT32_MAX;
+
+    // Смысл операндов зависит от op: индекс потомка в nodes_, начало списка в lists_
+    // (первый элемент списка - его длина), номер ячейки кадра либо индекс в одной из таблиц ниже
+    struct Node {
+        Op op;
+        std::uint32_t a = 0;
+        std::uint32_t b = 0;
+        std::uint32_t c = 0;
+    };
+
+    // Место вызова метода со своим встроенным кэшем
+    struct CallSite {
+        runtime::MethodId method;
+        runtime::MethodCache cache;
+    };
+
+    // Обращение к полю объекта со своим встроенным кэшем форм
+    struct FieldSite {
+        std::uint32_t name;
+        runtime::FieldCache cache;
+    };
+
+    class Interpreter;
+
+    // Ячейка кадра. Пустой optional - переменная ещё не присвоена
+    using Slot = std::optional<runtime::ObjectHolder>;
+
+    std::vector<Node> nodes_;
+    std::vector<std::uint32_t> lists_;
+    std::vector<std::string> names_;
+    // Константы и объявленные классы
+    std::vector<runtime::ObjectHolder> objects_;
+    std::vector<const runtime::Class*> classes_;
+    // Кэши заполняются при выполнении. init_caches_[i] хранит __init__ класса classes_[i]
+    mutable std::vector<CallSite> call_sites_;
+    mutable std::vector<FieldSite> field_sites_;
+    mutable std::vector<runtime::MethodCache> init_caches_;
+    std::vector<Comparison::Comparator> comparators_;
+    std::vector<std::unique_ptr<Statement>> opaque_;
+    std::uint32_t root_ = NO_NODE;
+    std::uint32_t frame_size_ = 0;
+    // Ячейки, в которые попадают self (всегда 0) и параметры метода
+    std::vector<std::uint32_t> param_slots_;
+};
+
+// Переводит дерево statement в линейное представление. Узлы дерева при этом разбираются
+std::unique_ptr<LinearCode> Linearize(std::unique_ptr<Statement> statement);
+
+// Переводит тело метода с параметрами formal_params в линейное представление
+// и назначает его локальным переменным ячейки кадра
+std::unique_ptr<LinearCode> LinearizeMethod(std::unique_ptr<Statement> body,
+                                            const std::vector<std::string>& formal_params);
+
+}  // namespace ast
@@ -1,15 +1,21 @@
+#include "cache.h"
 #include "lexer.h"
 #include "parse.h"
 #include "runtime.h"
 #include "statement.h"
 #include "test_runner.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <string_view>
+#include <thread>
 
 using namespace std;
 
 namespace parse {
 void RunOpenLexerTests(TestRunner& tr);
+void RunLexerBenchmarks(ostream& out);
 }  // namespace parse
 
 namespace ast {
@@ -21,20 +27,34 @@ void RunObjectsTests(TestRunner& tr);
 }  // namespace runtime
 
 void TestParseProgram(TestRunner& tr);
+void RunParseBenchmarks(ostream& out);
 
 namespace {
 
-void RunMythonProgram(istream& input, ostream& output) {
-    parse::Lexer lexer(input);
-    auto program = ParseProgram(lexer);
-
+void RunMythonProgram(runtime::Executable& program, ostream& output) {
     runtime::SimpleContext context{output};
     runtime::Closure closure;
-    program->Execute(closure, context);
+    program.Execute(closure, context);
+}
+
+void RunMythonProgram(parse::Lexer& lexer, ostream& output, Evaluator evaluator) {
+    auto program = ParseProgram(lexer, evaluator);
+    RunMythonProgram(*program, output);
+}
+
+// Выполняет program каждым вычислителем: вывод каждого должен совпасть с expected
+void AssertProgramOutput(const string& program, const string& expected) {
+    for (auto evaluator : {Evaluator::TREE, Evaluator::LINEAR, Evaluator::BYTECODE}) {
+        istringstream input(program);
+        parse::Lexer lexer(input);
+        ostringstream output;
+        RunMythonProgram(lexer, output, evaluator);
+        ASSERT_EQUAL(output.str(), expected);
+    }
 }
 
 void TestSimplePrints() {
-    istringstream input(R"(
+    const string program = R"(
 print 57
 print 10, 24, -8
 print 'hello'
@@ -42,16 +62,13 @@ print "world"
 print True, False
 print
 print None
-)");
-
-    ostringstream output;
-    RunMythonProgram(input, output);
+)";
 
-    ASSERT_EQUAL(output.str(), "57\n10 24 -8\nhello\nworld\nTrue False\n\nNone\n");
+    AssertProgramOutput(program, "57\n10 24 -8\nhello\nworld\nTrue False\n\nNone\n"s);
 }
 
 void TestAssignments() {
-    istringstream input(R"(
+    const string program = R"(
 x = 57
 print x
 x = 'C++ black belt'
@@ -61,25 +78,19 @@ x = y
 print x
 x = None
 print x, y
-)");
-
-    ostringstream output;
-    RunMythonProgram(input, output);
+)";
 
-    ASSERT_EQUAL(output.str(), "57\nC++ black belt\nFalse\nNone False\n");
+    AssertProgramOutput(program, "57\nC++ black belt\nFalse\nNone False\n"s);
 }
 
 void TestArithmetics() {
-    istringstream input("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2");
+    const string program = "print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2";
 
-    ostringstream output;
-    RunMythonProgram(input, output);
-
-    ASSERT_EQUAL(output.str(), "15 120 -13 3 15\n");
+    AssertProgramOutput(program, "15 120 -13 3 15\n"s);
 }
 
 void TestVariablesArePointers() {
-    istringstream input(R"(
+    const string program = R"(
 class Counter:
   def __init__():
     self.value = 0
@@ -103,12 +114,9 @@ d = Dummy()
 d.do_add(x)
 
 print y.value
-)");
-
-    ostringstream output;
-    RunMythonProgram(input, output);
+)";
 
-    ASSERT_EQUAL(output.str(), "2\n3\n");
+    AssertProgramOutput(program, "2\n3\n"s);
 }
 
 void TestAll() {
@@ -127,11 +135,33 @@ void TestAll() {
 
 }  // namespace
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
         TestAll();
 
-        RunMythonProgram(cin, cout);
+        if (argc > 1 && argv[1] == "--bench"sv) {
+            parse::RunLexerBenchmarks(cout);
+            RunParseBenchmarks(cout);
+        } else if (argc > 1) {
+            parse::MappedFile source(argv[1]);
+            const size_t threads = max(thread::hardware_concurrency(), 1u);
+            unique_ptr<ast::Program> program;
+            // С каталогом кэша повторный запуск той же программы пропускает разбор
+            if (const char* cache_directory = getenv("MYTHON_CACHE_DIR")) {
+                ProgramCache cache(cache_directory);
+                program = cache.Load(source.Data(), Evaluator::BYTECODE, threads);
+            } else {
+                program = ParseProgramParallel(source.Data(), threads, 64 * 1024,
+                                               Evaluator::BYTECODE);
+            }
+            RunMythonProgram(*program, cout);
+        } else {
+            // Второе ядро читает лексемы, пока первое разбирает программу
+            const auto mode = thread::hardware_concurrency() > 1 ? parse::Lexer::Mode::PIPELINED
+                                                                 : parse::Lexer::Mode::STREAMING;
+            parse::Lexer lexer(cin, mode);
+            RunMythonProgram(lexer, cout, Evaluator::BYTECODE);
+        }
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
 		return 1;
@@ -0,0 +1,36 @@
+#include "method_cache.h"
+
+namespace runtime {
+
+const Method* MethodCache::Miss(const Class& cls, MethodId id, size_t arity) {
+    ++misses_;
+    const Method* method = cls.GetMethod(id, arity);
+    if (megamorphic_) {
+        return method;
+    }
+    if (size_ == CAPACITY) {
+        megamorphic_ = true;
+        size_ = 0;
+        return method;
+    }
+    entries_[size_++] = {&cls, method};
+    return method;
+}
+
+size_t MethodCache::Hits() const {
+    return hits_;
+}
+
+size_t MethodCache::Misses() const {
+    return misses_;
+}
+
+size_t MethodCache::Size() const {
+    return size_;
+}
+
+bool MethodCache::IsMegamorphic() const {
+    return megamorphic_;
+}
+
+}  // namespace runtime
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace runtime {
+
+// Встроенный кэш места вызова метода: для классов объектов, встреченных в этом месте,
+// запоминает найденный метод, и повторный вызов обходится без обращения к таблице класса.
+// Кэш хранит не больше CAPACITY классов. Место вызова с большим числом классов
+// становится мегаморфным: кэш очищается, и дальше метод всегда ищется через Class::GetMethod
+class MethodCache {
+public:
+    static constexpr size_t CAPACITY = 4;
+
+    // Возвращает метод класса cls с номером имени method, принимающий arity параметров,
+    // либо nullptr, если такого метода нет. Место вызова всегда передаёт одни и те же
+    // method и arity
+    const Method* Find(const Class& cls, MethodId method, size_t arity) {
+        for (uint32_t i = 0; i < size_; ++i) {
+            if (entries_[i].cls == &cls) {
+                ++hits_;
+                return entries_[i].method;
+            }
+        }
+        return Miss(cls, method, arity);
+    }
+
+    // Сколько раз метод нашёлся в кэше и сколько раз его пришлось искать в классе
+    [[nodiscard]] size_t Hits() const;
+    [[nodiscard]] size_t Misses() const;
+
+    // Сколько классов сейчас в кэше
+    [[nodiscard]] size_t Size() const;
+
+    [[nodiscard]] bool IsMegamorphic() const;
+
+private:
+    const Method* Miss(const Class& cls, MethodId id, size_t arity);
+
+    struct Entry {
+        const Class* cls = nullptr;
+        const Method* method = nullptr;
+    };
+
+    std::array<Entry, CAPACITY> entries_;
+    uint32_t size_ = 0;
+    bool megamorphic_ = false;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+}  // namespace runtime
@@ -0,0 +1,262 @@
+#include "optimize.h"
+
+#include <initializer_list>
+#include <stdexcept>
+#include <typeinfo>
+#include <unordered_map>
+
+using namespace std;
+
+namespace ast {
+
+using runtime::ObjectHolder;
+
+namespace {
+
+using Comparator = bool (*)(const ObjectHolder&, const ObjectHolder&, runtime::Context&);
+
+// Сравнения из runtime не имеют побочных эффектов для чисел, строк и Bool.
+// Произвольный Comparator может их иметь, поэтому такие сравнения не сворачиваются
+bool IsRuntimeComparator(const Comparison::Comparator& cmp) {
+    const auto* function = cmp.target<Comparator>();
+    if (function == nullptr) {
+        return false;
+    }
+    for (Comparator known : {runtime::Equal, runtime::NotEqual, runtime::Less, runtime::Greater,
+                             runtime::LessOrEqual, runtime::GreaterOrEqual}) {
+        if (*function == known) {
+            return true;
+        }
+    }
+    return false;
+}
+
+unique_ptr<Statement> MakeConstant(const ObjectHolder& value) {
+    if (const auto* boolean = value.TryAs<runtime::Bool>()) {
+        return make_unique<BoolConst>(runtime::Bool(boolean->GetValue()));
+    }
+    if (const auto* number = value.TryAs<runtime::Number>()) {
+        return make_unique<NumericConst>(runtime::Number(number->GetValue()));
+    }
+    if (const auto* str = value.TryAs<runtime::String>()) {
+        return make_unique<StringConst>(runtime::String(str->GetValue()));
+    }
+    return nullptr;
+}
+
+bool IsConstant(const unique_ptr<Statement>& statement) {
+    if (!statement) {
+        return false;
+    }
+    const type_info& type = typeid(*statement);
+    return type == typeid(NumericConst) || type == typeid(StringConst) || type == typeid(BoolConst);
+}
+
+}  // namespace
+
+class ConstantFolder {
+public:
+    void Fold(unique_ptr<Statement>& statement) {
+        if (!statement) {
+            return;
+        }
+        statement->ForEachChild([this](unique_ptr<Statement>& child) {
+            Fold(child);
+        });
+        Simplify(statement);
+    }
+
+    [[nodiscard]] size_t Removed() const {
+        return removed_;
+    }
+
+private:
+    static size_t CountNodes(const unique_ptr<Statement>& statement) {
+        if (!statement) {
+            return 0;
+        }
+        size_t count = 1;
+        statement->ForEachChild([&count](unique_ptr<Statement>& child) {
+            count += CountNodes(child);
+        });
+        return count;
+    }
+
+    static bool DefinesClass(const unique_ptr<Statement>& statement) {
+        if (!statement) {
+            return false;
+        }
+        if (typeid(*statement) == typeid(ClassDefinition)) {
+            return true;
+        }
+        bool found = false;
+        statement->ForEachChild([&found](unique_ptr<Statement>& child) {
+            found = found || DefinesClass(child);
+        });
+        return found;
+    }
+
+    // Операции, результат которых зависит только от значений аргументов
+    static bool IsPure(Statement& node) {
+        const type_info& type = typeid(node);
+        if (type == typeid(Comparison)) {
+            return IsRuntimeComparator(static_cast<Comparison&>(node).GetComparator());
+        }
+        return type == typeid(Add) || type == typeid(Sub) || type == typeid(Mult)
+            || type == typeid(Div) || type == typeid(Or) || type == typeid(And)
+            || type == typeid(Not) || type == typeid(Negate) || type == typeid(Stringify);
+    }
+
+    static const runtime::Bool* ConstantBool(const unique_ptr<Statement>& statement) {
+        if (!statement || typeid(*statement) != typeid(BoolConst)) {
+            return nullptr;
+        }
+        return &static_cast<BoolConst&>(*statement).GetConstant();
+    }
+
+    void Replace(unique_ptr<Statement>& statement, size_t nodes, unique_ptr<Statement> with) {
+        removed_ += nodes - CountNodes(with);
+        statement = std::move(with);
+    }
+
+    void Simplify(unique_ptr<Statement>& statement) {
+        Statement& node = *statement;
+        const type_info& type = typeid(node);
+
+        // Ветка, которая заведомо не выполнится, отбрасывается вместе с условием
+        if (type == typeid(IfElse)) {
+            auto& if_else = static_cast<IfElse&>(node);
+            if (const auto* condition = ConstantBool(if_else.GetCondition())) {
+                auto& taken = condition->GetValue() ? if_else.GetIfBody() : if_else.GetElseBody();
+                auto& skipped = condition->GetValue() ? if_else.GetElseBody() : if_else.GetIfBody();
+                // Класс из отброшенной ветки виден коду после if и живёт, пока жив его узел
+                if (DefinesClass(skipped)) {
+                    return;
+                }
+                const size_t nodes = CountNodes(statement);
+                auto branch = std::move(taken);
+                Replace(statement, nodes, branch ? std::move(branch) : make_unique<None>());
+            }
+            return;
+        }
+
+        // True or x и False and x не вычисляют x
+        if (type == typeid(Or) || type == typeid(And)) {
+            const auto* lhs = ConstantBool(static_cast<BinaryOperation&>(node).GetLhs());
+            if (lhs != nullptr && lhs->GetValue() == (type == typeid(Or))) {
+                const bool value = lhs->GetValue();
+                Replace(statement, CountNodes(statement), make_unique<BoolConst>(runtime::Bool(value)));
+                return;
+            }
+        }
+
+        if (!IsPure(node)) {
+            return;
+        }
+        // Логическая операция над константой другого типа - ошибка, которая должна возникнуть
+        // при выполнении, а не при разборе: её ветка может никогда не выполниться
+        const bool logical = type == typeid(Or) || type == typeid(And) || type == typeid(Not);
+        bool constant_arguments = true;
+        node.ForEachChild([&constant_arguments, logical](unique_ptr<Statement>& child) {
+            constant_arguments = constant_arguments
+                && (logical ? ConstantBool(child) != nullptr : IsConstant(child));
+        });
+        if (!constant_arguments) {
+            return;
+        }
+
+        ObjectHolder value;
+        try {
+            runtime::Closure closure;
+            runtime::DummyContext context;
+            value = node.Execute(closure, context);
+        } catch (const runtime_error&) {
+            // Ошибка должна возникнуть во время выполнения программы
+            return;
+        }
+        if (auto constant = MakeConstant(value)) {
+            Replace(statement, CountNodes(statement), std::move(constant));
+        }
+    }
+
+    size_t removed_ = 0;
+};
+
+size_t FoldConstants(unique_ptr<Statement>& statement) {
+    ConstantFolder folder;
+    folder.Fold(statement);
+    return folder.Removed();
+}
+
+class LocalResolver {
+public:
+    explicit LocalResolver(const vector<string>& formal_params) {
+        Slot("self"s);
+        for (const auto& param : formal_params) {
+            param_slots_.push_back(Slot(param));
+        }
+    }
+
+    size_t Resolve(MethodBody& body) {
+        if (!CanResolve(body)) {
+            return 0;
+        }
+        Assign(body);
+        const auto frame_size = static_cast<uint32_t>(slots_.size());
+        body.SetFrame(frame_size, std::move(param_slots_));
+        return frame_size;
+    }
+
+private:
+    // Проверяет, что ни одному узлу поддерева не нужен Closure. Узел, который обращается
+    // к переменным по имени в обход ячеек кадра, должен быть перечислен здесь
+    static bool CanResolve(Statement& node) {
+        const type_info& type = typeid(node);
+        if (type == typeid(ClassDefinition)
+            || (type == typeid(Print) && !static_cast<Print&>(node).GetName().empty())) {
+            return false;
+        }
+        bool resolvable = true;
+        node.ForEachChild([&resolvable](unique_ptr<Statement>& child) {
+            resolvable = resolvable && (!child || CanResolve(*child));
+        });
+        return resolvable;
+    }
+
+    void Assign(Statement& node) {
+        const type_info& type = typeid(node);
+        if (type == typeid(VariableValue)) {
+            Assign(static_cast<VariableValue&>(node));
+        } else if (type == typeid(Assignment)) {
+            auto& assignment = static_cast<Assignment&>(node);
+            assignment.SetSlot(Slot(assignment.GetName()));
+        } else if (type == typeid(FieldAssignment)) {
+            Assign(static_cast<FieldAssignment&>(node).GetObject());
+        }
+        node.ForEachChild([this](unique_ptr<Statement>& child) {
+            if (child) {
+                Assign(*child);
+            }
+        });
+    }
+
+    void Assign(VariableValue& variable) {
+        variable.SetSlot(Slot(variable.GetName()));
+    }
+
+    uint32_t Slot(const string& name) {
+        return slots_.try_emplace(name, static_cast<uint32_t>(slots_.size())).first->second;
+    }
+
+    unordered_map<string, uint32_t> slots_;
+    vector<uint32_t> param_slots_;
+};
+
+size_t ResolveLocals(Statement& body, const vector<string>& formal_params) {
+    if (typeid(body) != typeid(MethodBody)) {
+        return 0;
+    }
+    return LocalResolver{formal_params}.Resolve(static_cast<MethodBody&>(body));
+}
+
+}  // namespace ast
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "statement.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ast {
+
+/*
+Сворачивает константные подвыражения дерева statement: арифметику, конкатенацию строк,
+сравнения, логические операции, not, str и унарный минус над константами заменяет
+их значением, а ветки if с константным условием - выбранной веткой.
+Выражения, вычисление которых завершается ошибкой (например, деление на ноль),
+не сворачиваются: ошибка по-прежнему возникает во время выполнения и в том же месте.
+Возвращает число удалённых узлов
+*/
+size_t FoldConstants(std::unique_ptr<Statement>& statement);
+
+/*
+Назначает переменным тела метода body с параметрами formal_params ячейки кадра:
+self и параметры занимают первые ячейки, остальные переменные - следующие по порядку.
+Тело, которому нужен Closure (определение класса, печать переменной по имени),
+оставляется без изменений. Возвращает размер кадра либо 0, если ячейки не назначены
+*/
+size_t ResolveLocals(Statement& body, const std::vector<std::string>& formal_params);
+
+}  // namespace ast
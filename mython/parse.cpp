@@ -1,8 +1,17 @@
 #include "parse.h"
 
+#include "bytecode.h"
 #include "lexer.h"
+#include "linear.h"
+#include "optimize.h"
 #include "statement.h"
 
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <unordered_set>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
@@ -17,10 +26,109 @@ bool operator!=(const parse::Token& token, char c) {
     return !(token == c);
 }
 
+// Первое объявление класса с данным именем при параллельном разборе:
+// номер фрагмента и заготовка класса, которую заполняют после разбора всех фрагментов
+struct ClassShell {
+    size_t chunk;
+    runtime::ObjectHolder holder;
+};
+
+using ClassShells = unordered_map<string, ClassShell>;
+
+// Класс, разобранный во фрагменте. Методы переносятся в заготовку при сшивке,
+// строго в порядке объявления, чтобы базовый класс был готов раньше наследника
+struct PendingClass {
+    runtime::ObjectHolder holder;
+    string name;
+    vector<runtime::Method> methods;
+    const runtime::Class* base;
+};
+
+// Классы, объявленные до точки разбора, по именам
+using ClassScope = unordered_map<string, const runtime::Class*>;
+
+// Лексемы отложенного тела метода и всё, что нужно, чтобы разобрать их так же,
+// как при разборе программы
+struct DeferredBody {
+    Evaluator evaluator = Evaluator::TREE;
+    // Классы, видимые в месте объявления метода
+    shared_ptr<ClassScope> declared_classes;
+    shared_ptr<const ClassScope> earlier_chunks;
+    vector<string> formal_params;
+    // Лексемы тела от Newline до парного Dedent. Значения Id и String указывают в text
+    vector<parse::Token> tokens;
+    unique_ptr<char[]> text;
+};
+
+// Тело метода, которое разбирается при первом вызове.
+// Выполнение программы однопоточное, поэтому разбор не синхронизируется
+class LazyMethodBody : public runtime::Executable {
+public:
+    explicit LazyMethodBody(unique_ptr<DeferredBody> deferred)
+        : deferred_(std::move(deferred)) {
+    }
+
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override {
+        return Body().Execute(closure, context);
+    }
+
+    runtime::ObjectHolder ExecuteMethod(const vector<string>& formal_params,
+                                        const runtime::ObjectHolder& self,
+                                        const vector<runtime::ObjectHolder>& actual_args,
+                                        runtime::Context& context) override {
+        return Body().ExecuteMethod(formal_params, self, actual_args, context);
+    }
+
+    // Разбирает тело, не сохраняя результат: выбрасывает те же ошибки, что и разбор при вызове
+    void Validate() const;
+
+private:
+    runtime::Executable& Body();
+
+    [[nodiscard]] vector<parse::TokenSpan> Tokens() const {
+        const auto& tokens = deferred_->tokens;
+        return {parse::TokenSpan{tokens.data(), tokens.data() + tokens.size()}};
+    }
+
+    // Освобождается после разбора
+    unique_ptr<DeferredBody> deferred_;
+    unique_ptr<runtime::Executable> body_;
+};
+
 class Parser {
 public:
-    explicit Parser(parse::Lexer& lexer)
-        : lexer_(lexer) {
+    // Узлы программы переводятся в представление evaluator
+    Parser(parse::Lexer& lexer, Evaluator evaluator, MethodBodies bodies)
+        : lexer_(lexer)
+        , evaluator_(evaluator)
+        , bodies_(bodies) {
+    }
+
+    // Разбор фрагмента chunk программы. Классы из предыдущих фрагментов берутся из shells,
+    // классы самого фрагмента откладываются в pending
+    Parser(parse::Lexer& lexer, Evaluator evaluator, MethodBodies bodies,
+           const ClassShells& shells, size_t chunk, vector<PendingClass>& pending)
+        : lexer_(lexer)
+        , evaluator_(evaluator)
+        , bodies_(bodies)
+        , shells_(&shells)
+        , chunk_(chunk)
+        , pending_(&pending) {
+        auto earlier_chunks = make_shared<ClassScope>();
+        for (const auto& [name, shell] : shells) {
+            if (shell.chunk < chunk) {
+                earlier_chunks->emplace(name, shell.holder.TryAs<runtime::Class>());
+            }
+        }
+        earlier_chunks_ = std::move(earlier_chunks);
+    }
+
+    // Разбор отложенного тела метода в окружении, в котором метод был объявлен
+    Parser(parse::Lexer& lexer, const DeferredBody& deferred)
+        : lexer_(lexer)
+        , evaluator_(deferred.evaluator)
+        , declared_classes_(deferred.declared_classes)
+        , earlier_chunks_(deferred.earlier_chunks) {
     }
 
     // Program -> eps
@@ -31,10 +139,51 @@ public:
             result->AddStatement(ParseStatement());
         }
 
-        return result;
+        return Finish(std::move(result));
+    }
+
+    // MethodBody -> Suite Eof
+    unique_ptr<ast::Statement> ParseMethodBody(const vector<string>& formal_params) {
+        auto body = make_unique<ast::MethodBody>(ParseSuite());
+        lexer_.Expect<TokenType::Eof>();
+        return Finish(std::move(body), &formal_params);
+    }
+
+    // Проверяет синтаксис тела метода. Разобранное дерево не сохраняется
+    void ValidateMethodBody() {
+        ParseSuite();
+        lexer_.Expect<TokenType::Eof>();
+    }
+
+    // Возвращает число узлов, удалённых свёрткой констант
+    size_t FoldedNodes() const {
+        return folded_nodes_;
     }
 
 private:
+    // Сворачивает константы в готовом дереве и переводит его в выбранное представление
+    // Телу метода передаются его параметры formal_params, чтобы назначить переменным ячейки кадра
+    unique_ptr<ast::Statement> Finish(unique_ptr<ast::Statement> tree,
+                                      const vector<string>* formal_params = nullptr) {
+        folded_nodes_ += ast::FoldConstants(tree);
+        if (evaluator_ == Evaluator::LINEAR) {
+            if (formal_params != nullptr) {
+                return ast::LinearizeMethod(std::move(tree), *formal_params);
+            }
+            return ast::Linearize(std::move(tree));
+        }
+        if (evaluator_ == Evaluator::BYTECODE) {
+            if (formal_params != nullptr) {
+                return ast::CompileMethod(std::move(tree), *formal_params);
+            }
+            return ast::Compile(std::move(tree));
+        }
+        if (formal_params != nullptr) {
+            ast::ResolveLocals(*tree, *formal_params);
+        }
+        return tree;
+    }
+
     // Suite -> NEWLINE INDENT (Statement)+ DEDENT
     unique_ptr<ast::Statement> ParseSuite()  // NOLINT
     {
@@ -66,9 +215,9 @@ private:
             lexer_.ExpectNext<TokenType::Char>('(');
 
             if (lexer_.NextToken().Is<TokenType::Id>()) {
-                m.formal_params.push_back(lexer_.Expect<TokenType::Id>().value);
+                m.formal_params.emplace_back(lexer_.Expect<TokenType::Id>().value);
                 while (lexer_.NextToken() == ',') {
-                    m.formal_params.push_back(lexer_.ExpectNext<TokenType::Id>().value);
+                    m.formal_params.emplace_back(lexer_.ExpectNext<TokenType::Id>().value);
                 }
             }
 
@@ -76,31 +225,116 @@ private:
             lexer_.ExpectNext<TokenType::Char>(':');
             lexer_.NextToken();
 
-            m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+            if (bodies_ == MethodBodies::EAGER) {
+                m.body = Finish(std::make_unique<ast::MethodBody>(ParseSuite()),  // NOLINT
+                                &m.formal_params);
+            } else {
+                m.body = DeferMethodBody(m.formal_params);
+            }
 
             result.push_back(std::move(m));
         }
         return result;
     }
 
+    // Копирует лексемы тела метода, чтобы разобрать их при первом вызове. Тело, в котором
+    // объявлен класс, разбирается сразу: класс должен быть виден коду после метода
+    unique_ptr<ast::Statement> DeferMethodBody(const vector<string>& formal_params) {
+        auto deferred = make_unique<DeferredBody>();
+        if (!RecordSuite(deferred->tokens)) {
+            return Finish(std::make_unique<ast::MethodBody>(ParseSuite()), &formal_params);
+        }
+        OwnTokenText(*deferred);
+        deferred->evaluator = evaluator_;
+        deferred->declared_classes = declared_classes_;
+        deferred->earlier_chunks = earlier_chunks_;
+        deferred->formal_params = formal_params;
+
+        auto body = make_unique<LazyMethodBody>(std::move(deferred));
+        if (bodies_ == MethodBodies::LAZY_VALIDATED) {
+            body->Validate();
+        }
+        return body;
+    }
+
+    // Копирует в tokens лексемы блока от текущего Newline до парного Dedent
+    // и сдвигает лексер за блок. Возвращает false, не сдвигая лексер, если в блоке
+    // объявлен класс или блок не начинается с Newline Indent (ошибку сообщит ParseSuite)
+    bool RecordSuite(vector<parse::Token>& tokens) {
+        if (!lexer_.CurrentToken().Is<TokenType::Newline>()
+            || !lexer_.PeekToken().Is<TokenType::Indent>()) {
+            return false;
+        }
+        tokens.push_back(lexer_.CurrentToken());
+        size_t depth = 0;
+        for (size_t offset = 1;; ++offset) {
+            parse::Token token = lexer_.PeekToken(offset);
+            if (token.Is<TokenType::Class>() || token.Is<TokenType::Eof>()) {
+                tokens.clear();
+                return false;
+            }
+            if (token.Is<TokenType::Indent>()) {
+                ++depth;
+            } else if (token.Is<TokenType::Dedent>()) {
+                --depth;
+            }
+            tokens.push_back(std::move(token));
+            if (depth == 0) {
+                break;
+            }
+        }
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            lexer_.NextToken();
+        }
+        return true;
+    }
+
+    // Копирует значения Id и String в deferred.text, чтобы лексемы пережили лексер
+    static void OwnTokenText(DeferredBody& deferred) {
+        size_t size = 0;
+        for (auto& token : deferred.tokens) {
+            if (const string_view* text = TokenText(token)) {
+                size += text->size();
+            }
+        }
+        deferred.text = make_unique<char[]>(size);
+        char* out = deferred.text.get();
+        for (auto& token : deferred.tokens) {
+            if (string_view* text = TokenText(token)) {
+                out = copy(text->begin(), text->end(), out);
+                *text = string_view(out - text->size(), text->size());
+            }
+        }
+    }
+
+    static string_view* TokenText(parse::Token& token) {
+        auto& base = static_cast<parse::TokenBase&>(token);
+        if (auto* id = get_if<TokenType::Id>(&base)) {
+            return &id->value;
+        }
+        if (auto* str = get_if<TokenType::String>(&base)) {
+            return &str->value;
+        }
+        return nullptr;
+    }
+
     // ClassDefinition -> Id ['(' Id ')'] : new_line indent MethodList dedent
     unique_ptr<ast::Statement> ParseClassDefinition()  // NOLINT
     {
-        string class_name = lexer_.Expect<TokenType::Id>().value;
+        string class_name(lexer_.Expect<TokenType::Id>().value);
 
         lexer_.NextToken();
 
         const runtime::Class* base_class = nullptr;
         if (lexer_.CurrentToken() == '(') {
-            auto name = lexer_.ExpectNext<TokenType::Id>().value;
+            string name(lexer_.ExpectNext<TokenType::Id>().value);
             lexer_.ExpectNext<TokenType::Char>(')');
             lexer_.NextToken();
 
-            auto it = declared_classes_.find(name);
-            if (it == declared_classes_.end()) {
+            base_class = FindClass(name);
+            if (base_class == nullptr) {
                 throw ParseError("Base class "s + name + " not found for class "s + class_name);
             }
-            base_class = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
         }
 
         lexer_.Expect<TokenType::Char>(':');
@@ -112,23 +346,52 @@ private:
         lexer_.Expect<TokenType::Dedent>();
         lexer_.NextToken();
 
-        auto [it, inserted] = declared_classes_.insert({
-            class_name,
-            runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class)),
-        });
-
-        if (!inserted) {
+        if (FindClass(class_name) != nullptr) {
             throw ParseError("Class "s + class_name + " already exists"s);
         }
 
-        return make_unique<ast::ClassDefinition>(it->second);
+        runtime::ObjectHolder cls;
+        if (pending_ != nullptr) {
+            // Базовый класс может быть заготовкой, которую заполнят только при сшивке,
+            // поэтому методы переносятся в любой класс фрагмента там же
+            auto shell = shells_->find(class_name);
+            if (shell != shells_->end() && shell->second.chunk == chunk_) {
+                cls = shell->second.holder;
+            } else {
+                cls = runtime::ObjectHolder::Own(runtime::Class(class_name, {}, nullptr));
+            }
+            pending_->push_back({cls, class_name, std::move(methods), base_class});
+        } else {
+            cls = runtime::ObjectHolder::Own(
+                runtime::Class(class_name, std::move(methods), base_class));
+        }
+        // Прежний набор классов может быть у отложенных тел методов, он не меняется
+        if (declared_classes_.use_count() > 1) {
+            declared_classes_ = make_shared<ClassScope>(*declared_classes_);
+        }
+        declared_classes_->emplace(class_name, cls.TryAs<runtime::Class>());
+
+        return make_unique<ast::ClassDefinition>(std::move(cls));
+    }
+
+    // Класс name, объявленный раньше текущей позиции, либо nullptr
+    const runtime::Class* FindClass(const string& name) const {
+        if (auto it = declared_classes_->find(name); it != declared_classes_->end()) {
+            return it->second;
+        }
+        if (earlier_chunks_ != nullptr) {
+            if (auto it = earlier_chunks_->find(name); it != earlier_chunks_->end()) {
+                return it->second;
+            }
+        }
+        return nullptr;
     }
 
     vector<string> ParseDottedIds() {
-        vector<string> result(1, lexer_.Expect<TokenType::Id>().value);
+        vector<string> result(1, string(lexer_.Expect<TokenType::Id>().value));
 
         while (lexer_.NextToken() == '.') {
-            result.push_back(lexer_.ExpectNext<TokenType::Id>().value);
+            result.emplace_back(lexer_.ExpectNext<TokenType::Id>().value);
         }
 
         return result;
@@ -224,7 +487,7 @@ private:
         }
         if (lexer_.CurrentToken() == '-') {
             lexer_.NextToken();
-            return make_unique<ast::Mult>(ParseMult(), make_unique<ast::NumericConst>(-1));
+            return make_unique<ast::Negate>(ParseMult());
         }
         if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::Number>()) {
             int result = num->value;
@@ -232,7 +495,7 @@ private:
             return make_unique<ast::NumericConst>(result);
         }
         if (const auto* str = lexer_.CurrentToken().TryAs<TokenType::String>()) {
-            string result = str->value;
+            string result(str->value);
             lexer_.NextToken();
             return make_unique<ast::StringConst>(std::move(result));
         }
@@ -272,9 +535,8 @@ private:
                     make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
                     std::move(args));
             }
-            if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
-                return make_unique<ast::NewInstance>(
-                    static_cast<const runtime::Class&>(*it->second), std::move(args));  // NOLINT
+            if (const runtime::Class* cls = FindClass(method_name)) {
+                return make_unique<ast::NewInstance>(*cls, std::move(args));
             }
             if (method_name == "str"sv) {
                 if (args.size() != 1) {
@@ -438,11 +700,170 @@ private:
     }
 
     parse::Lexer& lexer_;
-    runtime::Closure declared_classes_;
+    Evaluator evaluator_;
+    MethodBodies bodies_ = MethodBodies::EAGER;
+    shared_ptr<ClassScope> declared_classes_ = make_shared<ClassScope>();
+    // Классы из предыдущих фрагментов при параллельном разборе
+    shared_ptr<const ClassScope> earlier_chunks_;
+    const ClassShells* shells_ = nullptr;
+    size_t chunk_ = 0;
+    vector<PendingClass>* pending_ = nullptr;
+    size_t folded_nodes_ = 0;
 };
 
+runtime::Executable& LazyMethodBody::Body() {
+    if (!body_) {
+        parse::Lexer lexer(Tokens());
+        body_ = Parser{lexer, *deferred_}.ParseMethodBody(deferred_->formal_params);
+        deferred_.reset();
+    }
+    return *body_;
+}
+
+void LazyMethodBody::Validate() const {
+    parse::Lexer lexer(Tokens());
+    Parser{lexer, *deferred_}.ValidateMethodBody();
+}
+
+bool IsIdStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool IsIdChar(char c) {
+    return IsIdStart(c) || (c >= '0' && c <= '9');
+}
+
+// Первое слово строки line, начиная с позиции pos
+string_view WordAt(string_view line, size_t pos) {
+    size_t end = pos;
+    while (end < line.size() && IsIdChar(line[end])) {
+        ++end;
+    }
+    return line.substr(pos, end - pos);
+}
+
+// Делит программу на фрагменты по строкам с нулевым отступом, в каждом не меньше
+// chunk_size байт. Строка else не отделяется от своего if.
+// Попутно находит объявления классов верхнего уровня и создаёт для каждого имени заготовку
+vector<string_view> SplitTopLevel(string_view source, size_t chunk_size, ClassShells& shells) {
+    vector<string_view> chunks;
+    size_t chunk_start = 0;
+
+    for (size_t line_start = 0; line_start < source.size();) {
+        size_t line_end = source.find('\n', line_start);
+        if (line_end == string_view::npos) {
+            line_end = source.size();
+        }
+        const string_view line = source.substr(line_start, line_end - line_start);
+
+        size_t pos = 0;
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\r')) {
+            ++pos;
+        }
+        if (pos < line.size() && IsIdStart(line[pos])) {
+            const string_view word = WordAt(line, pos);
+            if (pos == 0 && line_start > chunk_start && line_start - chunk_start >= chunk_size
+                && word != "else"sv) {
+                chunks.push_back(source.substr(chunk_start, line_start - chunk_start));
+                chunk_start = line_start;
+            }
+            // Классы с отступом объявлены внутри блока и разбираются вместе с ним
+            if (pos == 0 && word == "class"sv) {
+                pos += word.size();
+                while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\r')) {
+                    ++pos;
+                }
+                if (pos < line.size() && IsIdStart(line[pos])) {
+                    string name(WordAt(line, pos));
+                    shells.try_emplace(name, ClassShell{chunks.size(),
+                        runtime::ObjectHolder::Own(runtime::Class(name, {}, nullptr))});
+                }
+            }
+        }
+        line_start = line_end + 1;
+    }
+    if (chunk_start < source.size()) {
+        chunks.push_back(source.substr(chunk_start));
+    }
+    return chunks;
+}
+
 }  // namespace
 
-unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
-    return Parser{lexer}.ParseProgram();
+unique_ptr<ast::Program> ParseProgram(parse::Lexer& lexer, Evaluator evaluator,
+                                      MethodBodies bodies) {
+    Parser parser{lexer, evaluator, bodies};
+    auto body = parser.ParseProgram();
+    return make_unique<ast::Program>(std::move(body), parser.FoldedNodes());
+}
+
+unique_ptr<ast::Program> ParseProgramParallel(string_view source, size_t threads,
+                                              size_t chunk_size, Evaluator evaluator,
+                                              MethodBodies bodies) {
+    ClassShells shells;
+    const vector<string_view> chunks = SplitTopLevel(source, chunk_size, shells);
+
+    vector<unique_ptr<ast::Statement>> parsed(chunks.size());
+    vector<vector<PendingClass>> pending(chunks.size());
+    vector<size_t> folded_nodes(chunks.size());
+    atomic<size_t> next_chunk{0};
+    atomic<size_t> first_error{chunks.size()};
+
+    auto worker = [&] {
+        for (size_t i = next_chunk++; i < chunks.size(); i = next_chunk++) {
+            // Фрагменты после уже найденной ошибки разбирать незачем
+            if (i > first_error.load(memory_order_relaxed)) {
+                continue;
+            }
+            try {
+                parse::Lexer lexer(chunks[i]);
+                Parser parser{lexer, evaluator, bodies, shells, i, pending[i]};
+                parsed[i] = parser.ParseProgram();
+                folded_nodes[i] = parser.FoldedNodes();
+            } catch (...) {
+                // Саму ошибку сообщит последовательный разбор
+                size_t expected = first_error.load(memory_order_relaxed);
+                while (i < expected && !first_error.compare_exchange_weak(expected, i)) {
+                }
+            }
+        }
+    };
+
+    threads = clamp<size_t>(threads, 1, max<size_t>(chunks.size(), 1));
+    vector<thread> pool;
+    pool.reserve(threads - 1);
+    for (size_t i = 1; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    // Фрагмент не видит классов, объявленных внутри блоков других фрагментов: такой класс
+    // не найдётся как базовый, а повтор его имени не будет ошибкой. Если хотя бы один фрагмент
+    // не разобрался или имя класса повторяется, программа разбирается последовательно,
+    // чтобы и результат, и ошибка совпали с ParseProgram
+    bool sequential = first_error.load() < chunks.size();
+    unordered_set<string_view> declared;
+    for (size_t i = 0; i < chunks.size() && !sequential; ++i) {
+        for (const auto& cls : pending[i]) {
+            sequential = sequential || !declared.insert(cls.name).second;
+        }
+    }
+    if (sequential) {
+        parse::Lexer lexer(source);
+        return ParseProgram(lexer, evaluator, bodies);
+    }
+
+    auto body = make_unique<ast::Compound>();
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        for (auto& cls : pending[i]) {
+            static_cast<runtime::Class&>(*cls.holder) =  // NOLINT
+                runtime::Class(std::move(cls.name), std::move(cls.methods), cls.base);
+        }
+        body->AddStatement(std::move(parsed[i]));
+    }
+    return make_unique<ast::Program>(std::move(body),
+                                     accumulate(folded_nodes.begin(), folded_nodes.end(), size_t{0}));
 }
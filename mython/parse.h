@@ -1,18 +1,52 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <stdexcept>
+#include <string_view>
 
 namespace parse {
 class Lexer;
 }
 
-namespace runtime {
-class Executable;
+namespace ast {
+class Program;
 }
 
 struct ParseError : std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
-std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
+// Представление, в котором исполняется разобранная программа
+enum class Evaluator {
+    // Обход дерева узлов ast
+    TREE,
+    // Обход плоского массива узлов (см. ast::LinearCode)
+    LINEAR,
+    // Стековая виртуальная машина (см. ast::Bytecode)
+    BYTECODE,
+};
+
+// Когда разбираются тела методов
+enum class MethodBodies {
+    // Вместе с программой
+    EAGER,
+    // При первом вызове метода. Во время разбора программы лексемы тела только
+    // копируются, синтаксические ошибки в теле сообщаются при вызове метода
+    LAZY,
+    // При первом вызове метода, но синтаксис всех тел проверяется сразу, как в EAGER
+    LAZY_VALIDATED,
+};
+
+std::unique_ptr<ast::Program> ParseProgram(parse::Lexer& lexer,
+                                           Evaluator evaluator = Evaluator::TREE,
+                                           MethodBodies bodies = MethodBodies::EAGER);
+
+// Разбирает программу source на threads потоках. Программа делится на фрагменты
+// не меньше chunk_size байт по строкам с нулевым отступом, фрагменты разбираются
+// независимо и сшиваются по порядку. Результат и ошибки совпадают с ParseProgram:
+// программу с ошибкой или повтором имени класса разбирает последовательный разбор
+std::unique_ptr<ast::Program> ParseProgramParallel(std::string_view source, size_t threads,
+                                                   size_t chunk_size = 64 * 1024,
+                                                   Evaluator evaluator = Evaluator::TREE,
+                                                   MethodBodies bodies = MethodBodies::EAGER);
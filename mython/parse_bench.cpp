@@ -0,0 +1,73 @@
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+constexpr int RUNS = 5;
+
+// Лучшее время из нескольких запусков, в секундах
+template <typename Fn>
+double BestOf(Fn fn) {
+    double best = 1e9;
+    for (int run = 0; run < RUNS; ++run) {
+        const auto start = chrono::steady_clock::now();
+        fn();
+        const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+// Много классов верхнего уровня с методами и код между ними, который ими пользуется
+string MakeParseCorpus() {
+    string source;
+    for (int i = 0; i < 4000; ++i) {
+        const string name = "Shape"s + to_string(i);
+        source += "class "s + name + ":\n"s;
+        source += "  def __init__(w, h):\n    self.w = w\n    self.h = h\n\n"s;
+        source += "  def area():\n    if self.w > 0 and self.h > 0:\n"s;
+        source += "      return self.w * self.h + "s + to_string(i) + "\n"s;
+        source += "    else:\n      return 0\n\n"s;
+        source += "  def __str__():\n    return 'shape "s + to_string(i) + "'\n\n"s;
+        source += "s = "s + name + "(2, 3)\n"s;
+        source += "x = s.area() * (1 + 2) - 4 / 2\n"s;
+    }
+    return source;
+}
+
+}  // namespace
+
+void RunParseBenchmarks(ostream& out) {
+    const string source = MakeParseCorpus();
+    const double megabytes = static_cast<double>(source.size()) / (1024 * 1024);
+    out << fixed << setprecision(1);
+
+    const double sequential = BestOf([&] {
+        parse::Lexer lexer(source);
+        ParseProgram(lexer, Evaluator::BYTECODE);
+    });
+    out << "parse sequential: "sv << megabytes << " MB, "sv << megabytes / sequential
+        << " MB/s"sv << endl;
+
+    double one_thread = 0;
+    for (size_t threads : {1, 2, 4, 8}) {
+        const double elapsed = BestOf([&] {
+            ParseProgramParallel(source, threads, 64 * 1024, Evaluator::BYTECODE);
+        });
+        if (threads == 1) {
+            one_thread = elapsed;
+        }
+        out << "parse "sv << threads << " threads: "sv << setprecision(1)
+            << megabytes / elapsed << " MB/s (x"sv << setprecision(2) << one_thread / elapsed
+            << ')' << endl;
+    }
+}
@@ -1,9 +1,13 @@
+#include "cache.h"
 #include "lexer.h"
 #include "parse.h"
 #include "statement.h"
 
 #include <test_runner.h>
 
+#include <filesystem>
+#include <fstream>
+
 using namespace std;
 
 namespace parse {
@@ -245,6 +249,554 @@ print r, c, t1, t2
                  "Rect(10x20) Circle(52) Triangle(3, 4, 5) Wrong triangle\n"s);
 }
 
+void TestParallelParseMatchesSequential() {
+    const string program = R"(
+class Shape:
+  def area():
+    return 0
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.w = w
+    self.h = h
+
+  def __str__():
+    return 'Rect'
+
+  def area():
+    return self.w * self.h
+
+class Square(Rect):
+  def __init__(a):
+    self.w = a
+    self.h = a
+
+    # комментарий с отступом
+x = 0
+if x > 0:
+  print 'positive'
+else:
+  print 'not positive'
+
+class Factory:
+  def area_of_square(a):
+    square = Square(a)
+    return square.area()
+
+f = Factory()
+s = Square(3)
+r = Rect(2, 5)
+print s, s.area(), r.area(), f.area_of_square(4)
+)"s;
+
+    runtime::DummyContext expected_context;
+    runtime::Closure expected_closure;
+    auto expected_tree = ParseProgramFromString(program);
+    expected_tree->Execute(expected_closure, expected_context);
+    ASSERT_EQUAL(expected_context.output.str(), "not positive\nRect 9 10 16\n"s);
+
+    for (size_t threads : {1, 2, 4, 8}) {
+        for (size_t chunk_size : {1, 40, 100000}) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            auto tree = ParseProgramParallel(program, threads, chunk_size);
+            tree->Execute(closure, context);
+            ASSERT_EQUAL(context.output.str(), expected_context.output.str());
+        }
+    }
+}
+
+void TestParallelParseErrors() {
+    // Базовый класс и конструктор видны только после объявления, как и при обычном разборе
+    const string use_before_declaration = "x = 1\nb = B()\nclass B:\n  def f():\n    return 1\n"s;
+    const string missing_base = "class A(B):\n  def f():\n    return 1\nclass B:\n  def f():\n    return 1\n"s;
+    const string duplicate = "class A:\n  def f():\n    return 1\nx = 1\nclass A:\n  def f():\n    return 1\n"s;
+    // Класс, объявленный внутри блока, тоже занимает имя
+    const string nested_duplicate =
+        "if True:\n  class A:\n    def f():\n      return 1\nclass A:\n  def f():\n    return 1\n"s;
+    // Ошибка в первом фрагменте важнее ошибки во втором
+    const string two_errors = "x = = 1\ny = 2\nz = C()\n"s;
+
+    for (const string& program :
+         {use_before_declaration, missing_base, duplicate, nested_duplicate, two_errors}) {
+        string expected;
+        try {
+            ParseProgramFromString(program);
+        } catch (const exception& e) {
+            expected = e.what();
+        }
+        ASSERT(!expected.empty());
+
+        for (size_t threads : {1, 4}) {
+            string actual;
+            try {
+                ParseProgramParallel(program, threads, 1);
+            } catch (const exception& e) {
+                actual = e.what();
+            }
+            ASSERT_EQUAL(actual, expected);
+        }
+    }
+}
+
+void TestParallelParseNestedClass() {
+    // Классы с отступом объявлены внутри блока, заготовки создаются только для классов
+    // верхнего уровня
+    const string program = R"(
+x = 1
+if x > 0:
+  class Local:
+    def f():
+      return 'local'
+  l = Local()
+  print l.f()
+class Outer:
+  def make():
+    class Inner:
+      def f():
+        return 'inner'
+    return Inner()
+o = Outer()
+i = o.make()
+print i.f()
+)"s;
+
+    for (size_t threads : {1, 4}) {
+        for (size_t chunk_size : {1, 100000}) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            auto tree = ParseProgramParallel(program, threads, chunk_size);
+            tree->Execute(closure, context);
+            ASSERT_EQUAL(context.output.str(), "local\ninner\n"s);
+        }
+    }
+}
+
+void TestParallelParseShellBase() {
+    // Наследник внутри блока получает методы базового класса верхнего уровня, а класс
+    // из блока одного фрагмента служит базовым для класса из следующего
+    const string program = R"(
+class A:
+  def hello():
+    return 'hello from A'
+if True:
+  class B(A):
+    def bye():
+      return 'bye from B'
+  class C:
+    def hello():
+      return 'hello from C'
+b = B()
+print b.hello(), b.bye()
+class D(C):
+  def bye():
+    return 'bye from D'
+d = D()
+print d.hello(), d.bye()
+)"s;
+
+    runtime::DummyContext expected_context;
+    runtime::Closure expected_closure;
+    ParseProgramFromString(program)->Execute(expected_closure, expected_context);
+    ASSERT_EQUAL(expected_context.output.str(),
+                 "hello from A bye from B\nhello from C bye from D\n"s);
+
+    for (size_t threads : {1, 4}) {
+        for (size_t chunk_size : {1, 100000}) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            auto tree = ParseProgramParallel(program, threads, chunk_size);
+            tree->Execute(closure, context);
+            ASSERT_EQUAL(context.output.str(), expected_context.output.str());
+        }
+    }
+}
+
+void TestClassOutlivesProgram() {
+    const string program = R"(
+class Greeter:
+  def greet(name):
+    print 'hello', name
+
+g = Greeter()
+)";
+    runtime::Closure closure;
+    runtime::DummyContext context;
+    {
+        istringstream is(program);
+        parse::Lexer lexer(is);
+        auto tree = ParseProgram(lexer);
+        tree->Execute(closure, context);
+    }
+
+    // Класс владеет телами своих методов и переживает программу
+    auto* greeter = closure.at("g"s).TryAs<runtime::ClassInstance>();
+    ASSERT(greeter != nullptr);
+    greeter->Call("greet"s, {runtime::ObjectHolder::Own(runtime::String("class"s))}, context);
+    ASSERT_EQUAL(context.output.str(), "hello class\n"s);
+}
+
+void TestEvaluatorsMatchTree() {
+    const vector<string> programs = {
+        R"(
+class Shape:
+  def __init__(w, h):
+    self.w = w
+    self.h = h
+  def area():
+    if self.w > 0 and self.h >= 0:
+      return self.w * self.h
+    else:
+      return 'negative'
+  def __str__():
+    return 'Shape ' + str(self.w) + 'x' + str(self.h)
+
+class Square(Shape):
+  def __init__(side):
+    self.w = side
+    self.h = side
+
+s = Square(3)
+r = Shape(-1, 2)
+print s, s.area(), r.area(), str(s.w / 2)
+)",
+        R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+class Holder:
+  def set(value):
+    self.inner = value
+
+f = Fib()
+h = Holder()
+h.set(Holder())
+h.inner.set(f)
+print f.calc(10), h.inner.inner.calc(6)
+x = not (1 == 2) or 1 / 0
+print x, None, not x and True
+)",
+        R"(
+class Broken:
+  def fail():
+    return 1 / 0
+
+b = Broken()
+print b.fail()
+print undefined
+)",
+        R"(
+class Node:
+  def __init__(value, next):
+    self.value = value
+    self.next = next
+  def sum():
+    if self.value > 2:
+      return self.value
+    return self.value + self.next.sum() * 1
+  def __str__():
+    return 'Node ' + str(self.value)
+
+class Counter:
+  def __init__():
+    self.count = 0
+  def add(node):
+    self.count = self.count + 1
+    print node, self.count
+    if self.count > 2:
+      return self.missing
+    return self.count
+
+n = Node(1, Node(2, Node(3, None)))
+c = Counter()
+print c.add(n), c.add(n.next), c.add(n.next.next), n.next.next.value
+print n.sum(), True or 1 / 0, False and 1 / 0
+c.count = 'x'
+print c.add(n)
+return c.count
+)",
+    };
+
+    for (const string& program : programs) {
+        string outputs[3];
+        for (auto evaluator : {Evaluator::TREE, Evaluator::LINEAR, Evaluator::BYTECODE}) {
+            istringstream is(program);
+            parse::Lexer lexer(is);
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            try {
+                ParseProgram(lexer, evaluator)->Execute(closure, context);
+            } catch (const exception& e) {
+                context.output << "error: "s << e.what();
+            }
+            outputs[static_cast<int>(evaluator)] = context.output.str();
+        }
+        ASSERT(!outputs[0].empty());
+        ASSERT_EQUAL(outputs[1], outputs[0]);
+        ASSERT_EQUAL(outputs[2], outputs[0]);
+    }
+}
+
+void TestReturnKeepsObject() {
+    const string program = R"(
+class Point:
+  def __init__(x):
+    self.x = x
+  def __eq__(other):
+    return self.x == other.x
+  def itself():
+    if self.x > 0:
+      return self
+    return None
+  def twice():
+    return self.x * 2
+    print 'unreachable'
+
+class Mover:
+  def move(point, dx):
+    return Point(point.x + dx)
+
+p = Point(1)
+m = Mover()
+q = m.move(p, 2)
+r = p.itself()
+r.x = 5
+print q.x, p.x, p.twice() + 1, p == Point(5), p == q
+)";
+
+    for (auto evaluator : {Evaluator::TREE, Evaluator::LINEAR, Evaluator::BYTECODE}) {
+        istringstream is(program);
+        parse::Lexer lexer(is);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        ParseProgram(lexer, evaluator)->Execute(closure, context);
+        ASSERT_EQUAL(context.output.str(), "3 5 11 True False\n"s);
+    }
+}
+
+void TestReturnedSelfOwnsObject() {
+    // Метод получает self невладеющей ссылкой, но return self должен продлить жизнь объекта
+    const string program = R"(
+class A:
+  def __init__():
+    self.v = 5
+  def me():
+    return self
+
+x = A()
+y = x.me()
+x = None
+print y.v
+)";
+
+    for (auto evaluator : {Evaluator::TREE, Evaluator::LINEAR, Evaluator::BYTECODE}) {
+        istringstream is(program);
+        parse::Lexer lexer(is);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        ParseProgram(lexer, evaluator)->Execute(closure, context);
+        ASSERT_EQUAL(context.output.str(), "5\n"s);
+    }
+}
+
+void TestConstantFolding() {
+    const string program = R"(
+class Calc:
+  def broken():
+    return 1 / 0
+
+c = Calc()
+print 1 + 2 * 3, -8, 'a' + 'b', not 1 < 2, str(-(2 - 5))
+print c.broken()
+)";
+
+    for (auto evaluator : {Evaluator::TREE, Evaluator::LINEAR, Evaluator::BYTECODE}) {
+        istringstream is(program);
+        parse::Lexer lexer(is);
+        auto tree = ParseProgram(lexer, evaluator);
+        ASSERT_EQUAL(tree->FoldedNodes(), 14U);
+
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        ASSERT_THROWS(tree->Execute(closure, context), runtime_error);
+        ASSERT_EQUAL(context.output.str(), "7 -8 ab False 3\n"s);
+    }
+}
+
+void TestFoldingKeepsTypeErrors() {
+    // Логические операции над константами другого типа не сворачиваются: ветка, которая
+    // не выполняется, не мешает разбору, а в выполняемой ошибка возникает при выполнении
+    const string program = R"(
+x = 0
+if x > 1:
+  print 1 and True, 1 or 'a', not 2, 2 and 3, True and 'a'
+print 'ok'
+print 1 and True
+)";
+
+    for (auto evaluator : {Evaluator::TREE, Evaluator::LINEAR, Evaluator::BYTECODE}) {
+        istringstream is(program);
+        parse::Lexer lexer(is);
+        auto tree = ParseProgram(lexer, evaluator);
+        ASSERT_EQUAL(tree->FoldedNodes(), 0U);
+
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        ASSERT_THROWS(tree->Execute(closure, context), runtime_error);
+        ASSERT_EQUAL(context.output.str(), "ok\n"s);
+    }
+}
+
+void TestProgramCache() {
+    const string source = R"(
+if False:
+  class Hidden:
+    def __str__():
+      return 'hidden'
+
+class Base:
+  def __init__(name):
+    self.name = name
+  def greet(other):
+    return 'hi ' + other.name + ' from ' + self.name
+
+class Child(Base):
+  def __str__():
+    return 'child ' + self.name
+
+a = Base('a')
+b = Child('b')
+print a.greet(b), b, Hidden(), 1 + 2 * 3, -4
+if a.name == 'a' and not b.name >= 'c':
+  print 'cmp', a.name != 'b', 2 <= 3
+else:
+  print 'never'
+print b.greet(a) + '!', str(10 / 3), None
+)";
+    auto run = [](ast::Program& program) {
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program.Execute(closure, context);
+        return context.output.str();
+    };
+
+    istringstream is(source);
+    parse::Lexer lexer(is);
+    auto fresh = ParseProgram(lexer);
+    const string expected = run(*fresh);
+    ASSERT_EQUAL(expected, "hi b from a child b hidden 7 -4\ncmp True True\nhi a from b! 3 None\n"s);
+
+    const string data = SerializeProgram(*fresh);
+    for (auto evaluator : {Evaluator::TREE, Evaluator::LINEAR, Evaluator::BYTECODE}) {
+        auto loaded = DeserializeProgram(data, evaluator);
+        ASSERT_EQUAL(loaded->FoldedNodes(), fresh->FoldedNodes());
+        ASSERT_EQUAL(run(*loaded), expected);
+    }
+    try {
+        DeserializeProgram(string_view(data).substr(0, data.size() - 1));
+        ASSERT(false);
+    } catch (const CacheError&) {
+    }
+
+    const auto directory = filesystem::temp_directory_path() / "mython_program_cache_test"s;
+    filesystem::remove_all(directory);
+    ProgramCache cache(directory.string());
+    ASSERT_EQUAL(run(*cache.Load(source, Evaluator::LINEAR)), expected);
+    ASSERT(filesystem::exists(cache.PathFor(source)));
+    ASSERT_EQUAL(run(*cache.Load(source, Evaluator::LINEAR)), expected);
+    ASSERT_EQUAL(run(*cache.Load(source, Evaluator::TREE)), expected);
+    ASSERT_EQUAL(cache.Hits(), 2U);
+    ASSERT_EQUAL(cache.Misses(), 1U);
+
+    // Повреждённый файл разбирается заново и перезаписывается
+    ofstream(cache.PathFor(source), ios::binary | ios::trunc) << "garbage"sv;
+    ASSERT_EQUAL(run(*cache.Load(source, Evaluator::LINEAR)), expected);
+    ASSERT_EQUAL(run(*cache.Load(source, Evaluator::LINEAR)), expected);
+    ASSERT_EQUAL(cache.Hits(), 3U);
+    ASSERT_EQUAL(cache.Misses(), 2U);
+    filesystem::remove_all(directory);
+}
+
+void TestLazyMethodBodies() {
+    auto parse = [](const string& program, Evaluator evaluator, MethodBodies bodies) {
+        istringstream is(program);
+        parse::Lexer lexer(is);
+        return ParseProgram(lexer, evaluator, bodies);
+    };
+    auto run = [](ast::Program& program) {
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program.Execute(closure, context);
+        return context.output.str();
+    };
+
+    const string valid = R"(
+class Base:
+  def __init__(name):
+    self.name = name
+  def greet(other):
+    return 'hi ' + other.name + ' from ' + self.name
+  def unused(x):
+    y = x * 2 + 1
+    if y > 10:
+      return str(y) + ' big'
+    return y
+
+class Child(Base):
+  def __str__():
+    return 'child ' + self.name
+
+a = Base('a')
+print a.greet(Child('b')), Child('c')
+)";
+    for (auto evaluator : {Evaluator::TREE, Evaluator::LINEAR, Evaluator::BYTECODE}) {
+        auto eager = parse(valid, evaluator, MethodBodies::EAGER);
+        auto lazy = parse(valid, evaluator, MethodBodies::LAZY);
+        ASSERT_EQUAL(run(*lazy), "hi b from a child c\n"s);
+        ASSERT_EQUAL(run(*eager), "hi b from a child c\n"s);
+    }
+
+    // Тела broken и later не разбираются, пока их не вызвали
+    const string broken = R"(
+class Calc:
+  def ok():
+    return 1
+  def broken():
+    return 1 +
+  def later():
+    return Later()
+
+class Later:
+  def __str__():
+    return 'later'
+
+c = Calc()
+print c.ok()
+)";
+    ASSERT_EQUAL(run(*parse(broken, Evaluator::LINEAR, MethodBodies::LAZY)), "1\n"s);
+    for (auto bodies : {MethodBodies::EAGER, MethodBodies::LAZY_VALIDATED}) {
+        try {
+            parse(broken, Evaluator::TREE, bodies);
+            ASSERT(false);
+        } catch (const parse::LexerError&) {
+        }
+    }
+    try {
+        run(*parse(broken + "print c.broken()\n"s, Evaluator::LINEAR, MethodBodies::LAZY));
+        ASSERT(false);
+    } catch (const parse::LexerError&) {
+    }
+    // Класс Later объявлен после метода и не виден в его теле
+    try {
+        run(*parse(broken + "print c.later()\n"s, Evaluator::TREE, MethodBodies::LAZY));
+        ASSERT(false);
+    } catch (const ParseError&) {
+    }
+}
+
 }  // namespace parse
 
 void TestParseProgram(TestRunner& tr) {
@@ -256,4 +808,16 @@ void TestParseProgram(TestRunner& tr) {
     RUN_TEST(tr, parse::TestRecursion2);
     RUN_TEST(tr, parse::TestComplexLogicalExpression);
     RUN_TEST(tr, parse::TestClassicalPolymorphism);
+    RUN_TEST(tr, parse::TestParallelParseMatchesSequential);
+    RUN_TEST(tr, parse::TestParallelParseErrors);
+    RUN_TEST(tr, parse::TestParallelParseNestedClass);
+    RUN_TEST(tr, parse::TestParallelParseShellBase);
+    RUN_TEST(tr, parse::TestClassOutlivesProgram);
+    RUN_TEST(tr, parse::TestEvaluatorsMatchTree);
+    RUN_TEST(tr, parse::TestReturnKeepsObject);
+    RUN_TEST(tr, parse::TestReturnedSelfOwnsObject);
+    RUN_TEST(tr, parse::TestConstantFolding);
+    RUN_TEST(tr, parse::TestFoldingKeepsTypeErrors);
+    RUN_TEST(tr, parse::TestProgramCache);
+    RUN_TEST(tr, parse::TestLazyMethodBodies);
 }
@@ -1,25 +1,20 @@
 #include "runtime.h"
 
+#include <algorithm>
 #include <cassert>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <sstream>
+#include <stdexcept>
 #include <variant>
 
 using namespace std;
 
 namespace runtime {
 
-ObjectHolder::ObjectHolder(std::shared_ptr<Object> data)
-    : data_(std::move(data)) {
-}
-
 void ObjectHolder::AssertIsValid() const {
-    assert(data_ != nullptr);
-}
-
-ObjectHolder ObjectHolder::Share(Object& object) {
-    // Возвращаем невладеющий shared_ptr (его deleter ничего не делает)
-    return ObjectHolder(std::shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+    assert(Get() != nullptr);
 }
 
 ObjectHolder ObjectHolder::None() {
@@ -36,12 +31,15 @@ Object* ObjectHolder::operator->() const {
     return Get();
 }
 
-Object* ObjectHolder::Get() const {
-    return data_.get();
+void Context::SetReturnValue(ObjectHolder value) {
+    value.Retain();
+    return_value_ = std::move(value);
+    returning_ = true;
 }
 
-ObjectHolder::operator bool() const {
-    return Get() != nullptr;
+ObjectHolder Context::TakeReturnValue() {
+    returning_ = false;
+    return std::move(return_value_);
 }
 
 bool IsTrue(const ObjectHolder& object) {
@@ -61,9 +59,151 @@ bool IsTrue(const ObjectHolder& object) {
     return false;
 }
 
+namespace {
+
+// Номера имён методов, общие для всех классов процесса. Классы и узлы вызовов создаются
+// и в потоках параллельного разбора, поэтому таблица защищена мьютексом
+class MethodNames {
+public:
+    MethodNames() {
+        for (const char* name : {"__init__", "__str__", "__eq__", "__lt__", "__add__"}) {
+            ids_.emplace(name, static_cast<MethodId>(ids_.size()));
+        }
+        assert(ids_.at("__add__"s) == ADD_METHOD_ID);
+    }
+
+    optional<MethodId> Find(const std::string& name) {
+        shared_lock lock(mutex_);
+        if (auto it = ids_.find(name); it != ids_.end()) {
+            return it->second;
+        }
+        return nullopt;
+    }
+
+    MethodId Intern(const std::string& name) {
+        if (auto id = Find(name)) {
+            return *id;
+        }
+        unique_lock lock(mutex_);
+        return ids_.try_emplace(name, static_cast<MethodId>(ids_.size())).first->second;
+    }
+
+private:
+    shared_mutex mutex_;
+    unordered_map<string, MethodId> ids_;
+};
+
+MethodNames& Names() {
+    static MethodNames names;
+    return names;
+}
+
+}  // namespace
+
+MethodId InternMethodName(const std::string& name) {
+    return Names().Intern(name);
+}
+
+std::optional<MethodId> FindMethodName(const std::string& name) {
+    return Names().Find(name);
+}
+
+ObjectHolder Executable::ExecuteMethod(const std::vector<std::string>& formal_params,
+                                       const ObjectHolder& self,
+                                       const std::vector<ObjectHolder>& actual_args,
+                                       Context& context) {
+    Closure closure;
+    closure["self"] = self;
+
+    for (int i = 0; i < static_cast<int>(actual_args.size()); ++i) {
+        closure[formal_params[i]] = actual_args[i];
+    }
+
+    return Execute(closure, context);
+}
+
+size_t Shape::Find(const std::string& name) const {
+    if (names_.size() >= INDEX_THRESHOLD) {
+        auto it = index_.find(name);
+        return it != index_.end() ? it->second : NOT_FOUND;
+    }
+    for (size_t slot = 0; slot < names_.size(); ++slot) {
+        if (names_[slot] == name) {
+            return slot;
+        }
+    }
+    return NOT_FOUND;
+}
+
+const Shape& Shape::With(const std::string& name) const {
+    assert(Find(name) == NOT_FOUND);
+    for (const auto& [field, next] : transitions_) {
+        if (field == name) {
+            return *next;
+        }
+    }
+    auto next = make_unique<Shape>();
+    next->names_ = names_;
+    next->names_.push_back(name);
+    if (next->names_.size() >= INDEX_THRESHOLD) {
+        for (size_t slot = 0; slot < next->names_.size(); ++slot) {
+            next->index_.emplace(next->names_[slot], slot);
+        }
+    }
+    return *transitions_.emplace_back(name, std::move(next)).second;
+}
+
+ObjectHolder& FieldTable::Append(const Shape& next) {
+    const size_t slot = shape_->Size();
+    assert(next.Size() == slot + 1);
+    shape_ = &next;
+    if (slot < INLINE_SLOTS) {
+        return inline_[slot];
+    }
+    return outline_.emplace_back();
+}
+
+ObjectHolder& FieldTable::operator[](const std::string& name) {
+    if (const size_t slot = shape_->Find(name); slot != Shape::NOT_FOUND) {
+        return Slot(slot);
+    }
+    return Append(shape_->With(name));
+}
+
+ObjectHolder& FieldTable::at(const std::string& name) {
+    return const_cast<ObjectHolder&>(as_const(*this).at(name));
+}
+
+const ObjectHolder& FieldTable::at(const std::string& name) const {
+    const size_t slot = shape_->Find(name);
+    if (slot == Shape::NOT_FOUND) {
+        throw out_of_range("No field "s + name);
+    }
+    return Slot(slot);
+}
+
+FieldTable::iterator FieldTable::find(const std::string& name) {
+    const size_t slot = shape_->Find(name);
+    return {*this, slot == Shape::NOT_FOUND ? size() : slot};
+}
+
+FieldTable::const_iterator FieldTable::find(const std::string& name) const {
+    const size_t slot = shape_->Find(name);
+    return {*this, slot == Shape::NOT_FOUND ? size() : slot};
+}
+
+size_t FieldTable::count(const std::string& name) const {
+    return shape_->Find(name) == Shape::NOT_FOUND ? 0 : 1;
+}
+
 void ClassInstance::Print(std::ostream& os, Context& context) {
-    if (this->HasMethod("__str__"s, 0)) {
-       this->Call("__str__"s, {}, context).Get()->Print(os, context);
+    if (this->HasMethod(STR_METHOD_ID, 0)) {
+        const ObjectHolder result = this->Call(STR_METHOD_ID, {}, context);
+        if (result) {
+            result->Print(os, context);
+        } else {
+            os << "None"sv;
+        }
     }
     else {
         os << this;
@@ -71,73 +211,105 @@ void ClassInstance::Print(std::ostream& os, Context& context) {
 }
 
 bool ClassInstance::HasMethod(const std::string& method, size_t argument_count) const {
-    auto method_ptr = class_.GetMethod(method);
-    if (method_ptr != nullptr) {
-        return method_ptr->formal_params.size() == argument_count;
-    }
+    const auto id = FindMethodName(method);
+    return id.has_value() && HasMethod(*id, argument_count);
+}
 
-    return false;
+bool ClassInstance::HasMethod(MethodId method, size_t argument_count) const {
+    return class_.GetMethod(method, argument_count) != nullptr;
 }
 
-Closure& ClassInstance::Fields() {
-    return closure_;
+FieldTable& ClassInstance::Fields() {
+    return fields_;
 }
 
-const Closure& ClassInstance::Fields() const {
-    return closure_;
+const FieldTable& ClassInstance::Fields() const {
+    return fields_;
+}
+
+const Class& ClassInstance::GetClass() const {
+    return class_;
 }
 
 ClassInstance::ClassInstance(const Class& cls) 
-        :class_(cls){
+        : Object(ObjectKind::CLASS_INSTANCE)
+        , class_(cls)
+        , fields_(cls.GetRootShape()) {
 }
 
 ObjectHolder ClassInstance::Call(const std::string& method,
                                  const std::vector<ObjectHolder>& actual_args,
                                  Context& context) {
-    auto method_ptr = class_.GetMethod(method);
-
-    if (method_ptr != nullptr && method_ptr->formal_params.size() == actual_args.size()) {
-
-        Closure temp;
-        temp["self"] = ObjectHolder::Share(*this);
+    const auto id = FindMethodName(method);
+    return Call(id ? class_.GetMethod(*id, actual_args.size()) : nullptr, actual_args, context);
+}
 
-        for (int i = 0; i < static_cast<int>(actual_args.size()); ++i) {
-            temp[method_ptr->formal_params[i]] = actual_args[i];
-        }
+ObjectHolder ClassInstance::Call(MethodId method, const std::vector<ObjectHolder>& actual_args,
+                                 Context& context) {
+    return Call(class_.GetMethod(method, actual_args.size()), actual_args, context);
+}
 
-        return method_ptr->body.get()->Execute(temp, context);;
+ObjectHolder ClassInstance::Call(const Method* method,
+                                 const std::vector<ObjectHolder>& actual_args,
+                                 Context& context) {
+    if (method != nullptr && method->formal_params.size() == actual_args.size()) {
+        return method->body->ExecuteMethod(method->formal_params,
+                                           ObjectHolder::Share(*this), actual_args, context);
     }
-     throw std::runtime_error("Strange Method"s); ;
+    throw std::runtime_error("Strange Method"s);
 }
 
 Class::Class(std::string name, std::vector<Method> methods, const Class* parent)
-        : name_(name)
-        , parent_(parent){
+        : Object(ObjectKind::CLASS)
+        , name_(name)
+        , parent_(parent)
+        , root_shape_(make_unique<Shape>()) {
     for ( auto& method : methods) {
         methods_[method.name] = std::move(method);
     }
 
-    if (parent == nullptr) {
-        return;
+    BuildMethodsTable();
+}
+
+void Class::BuildMethodsTable() {
+    // Таблица родителя уже содержит методы всех его предков. Собственный метод скрывает
+    // унаследованные методы с тем же именем при любом числе параметров, как в GetMethod(name)
+    vector<TableEntry> entries;
+    if (parent_ != nullptr) {
+        for (const TableEntry& entry : parent_->methods_table_) {
+            if (entry.method != nullptr) {
+                entries.push_back(entry);
+            }
+        }
+    }
+    for (const auto& [name, method] : methods_) {
+        const MethodId id = InternMethodName(name);
+        entries.erase(remove_if(entries.begin(), entries.end(), [id](const TableEntry& entry) {
+            return entry.key >> 32 == id;
+        }), entries.end());
+        entries.push_back({MethodKey(id, method.formal_params.size()), &method});
     }
 
-    for (auto& method : parent->methods_) {
-        if (methods_.count(method.first) && 
-           (methods_.at(method.first).formal_params.size() == method.second.formal_params.size())) {
-            continue;
+    size_t capacity = 1;
+    while (capacity < entries.size() * 2) {
+        capacity *= 2;
+    }
+    methods_table_.assign(capacity, TableEntry{});
+    for (const TableEntry& entry : entries) {
+        size_t slot = SlotOf(entry.key);
+        while (methods_table_[slot].method != nullptr) {
+            slot = (slot + 1) & (capacity - 1);
         }
-        methods_ptr_[method.first] = &(parent->methods_.at(method.first));
+        methods_table_[slot] = entry;
     }
 }
 
 const Method* Class::GetMethod(const std::string& name) const {
-    if (methods_.count(name))  {
-        return &(methods_.at(name));
-    }
-    else if (methods_ptr_.count(name)) {
-        return methods_ptr_.at(name);
+    for (const Class* cls = this; cls != nullptr; cls = cls->parent_) {
+        if (auto it = cls->methods_.find(name); it != cls->methods_.end()) {
+            return &it->second;
+        }
     }
-
     return nullptr;
 }
 
@@ -145,6 +317,23 @@ const Method* Class::GetMethod(const std::string& name) const {
     return name_;
 }
 
+const Class* Class::GetParent() const {
+    return parent_;
+}
+
+std::vector<const Method*> Class::GetOwnMethods() const {
+    std::vector<const Method*> result;
+    result.reserve(methods_.size());
+    for (const auto& [name, method] : methods_) {
+        result.push_back(&method);
+    }
+    return result;
+}
+
+const Shape& Class::GetRootShape() const {
+    return *root_shape_;
+}
+
 void Class::Print(ostream& os, [[maybe_unused]] Context& context) {
     os <<"Class "s<< GetName();
 }
@@ -171,8 +360,8 @@ bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
 
     if (lhs.TryAs<ClassInstance>() != nullptr) {
         auto ptr = lhs.TryAs<ClassInstance>();
-        if (ptr->HasMethod("__eq__"s, 1)) {
-            ObjectHolder result = ptr->Call("__eq__", { rhs }, context);
+        if (ptr->HasMethod(EQ_METHOD_ID, 1)) {
+            ObjectHolder result = ptr->Call(EQ_METHOD_ID, { rhs }, context);
 
             if (result.TryAs<Bool>() != nullptr) {
                 return result.TryAs<Bool>()->GetValue();
@@ -199,8 +388,8 @@ bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
 
     if (lhs.TryAs<ClassInstance>() != nullptr) {
         auto ptr = lhs.TryAs<ClassInstance>();
-        if (ptr->HasMethod("__lt__"s, 1)) {
-            ObjectHolder result = ptr->Call("__lt__", { rhs }, context);
+        if (ptr->HasMethod(LT_METHOD_ID, 1)) {
+            ObjectHolder result = ptr->Call(LT_METHOD_ID, { rhs }, context);
 
             if (result.TryAs<Bool>() != nullptr) {
                 return result.TryAs<Bool>()->GetValue();
@@ -1,94 +1,389 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 
 namespace runtime {
 
-// Контекст исполнения инструкций Mython
-class Context {
-public:
-    // Возвращает поток вывода для команд print
-    virtual std::ostream& GetOutputStream() = 0;
-
-protected:
-    ~Context() = default;
+class Context;
+
+// Вид объекта. Для встроенных типов он хранится в самом объекте,
+// и ObjectHolder::TryAs проверяет его без dynamic_cast
+enum class ObjectKind : std::uint8_t {
+    NUMBER,
+    STRING,
+    BOOL,
+    CLASS,
+    CLASS_INSTANCE,
+    OTHER,
 };
 
-// Базовый класс для всех объектов языка Mython
+/*
+Базовый класс для всех объектов языка Mython.
+Объект, созданный через ObjectHolder::Own в куче, сам хранит число владеющих им ObjectHolder
+и удаляется вместе с последним из них. Интерпретатор работает с объектами программы
+в одном потоке, поэтому счётчик по умолчанию не атомарный. Если объекты нужно передавать
+между потоками, программу собирают с макросом MYTHON_ATOMIC_REFCOUNT
+*/
 class Object {
 public:
     virtual ~Object() = default;
     // выводит в os своё представление в виде строки
     virtual void Print(std::ostream& os, Context& context) = 0;
+
+    [[nodiscard]] ObjectKind GetKind() const {
+        return kind_;
+    }
+
+protected:
+    // Наследники, кроме встроенных типов, получают вид OTHER
+    Object() = default;
+
+    explicit Object(ObjectKind kind)
+        : kind_(kind) {
+    }
+
+    // Копия объекта - новый объект, на который ещё никто не ссылается.
+    // Присваивание не меняет ни вид объекта, ни число ссылок на него
+    Object(const Object& other) noexcept
+        : kind_(other.kind_) {
+    }
+
+    Object& operator=(const Object& /*other*/) noexcept {
+        return *this;
+    }
+
+private:
+    friend class ObjectHolder;
+
+#ifdef MYTHON_ATOMIC_REFCOUNT
+    using RefCount = std::atomic<std::uint32_t>;
+#else
+    using RefCount = std::uint32_t;
+#endif
+
+    void AddRef() const noexcept {
+#ifdef MYTHON_ATOMIC_REFCOUNT
+        refs_.fetch_add(1, std::memory_order_relaxed);
+#else
+        ++refs_;
+#endif
+    }
+
+    // Возвращает true, если объектом владеет хотя бы один ObjectHolder
+    bool HasOwners() const noexcept {
+#ifdef MYTHON_ATOMIC_REFCOUNT
+        return refs_.load(std::memory_order_acquire) != 0;
+#else
+        return refs_ != 0;
+#endif
+    }
+
+    // Возвращает true, если освобождена последняя ссылка
+    bool Release() const noexcept {
+#ifdef MYTHON_ATOMIC_REFCOUNT
+        return refs_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+#else
+        return --refs_ == 0;
+#endif
+    }
+
+    mutable RefCount refs_ = 0;
+    ObjectKind kind_ = ObjectKind::OTHER;
+};
+
+template <typename T>
+class ValueObject;
+class Bool;
+class Class;
+class ClassInstance;
+
+// Вид объектов типа T и его наследников. Для остальных типов - OTHER
+template <typename T>
+inline constexpr ObjectKind KIND_OF = ObjectKind::OTHER;
+template <>
+inline constexpr ObjectKind KIND_OF<ValueObject<int>> = ObjectKind::NUMBER;
+template <>
+inline constexpr ObjectKind KIND_OF<ValueObject<std::string>> = ObjectKind::STRING;
+template <>
+inline constexpr ObjectKind KIND_OF<Bool> = ObjectKind::BOOL;
+template <>
+inline constexpr ObjectKind KIND_OF<Class> = ObjectKind::CLASS;
+template <>
+inline constexpr ObjectKind KIND_OF<ClassInstance> = ObjectKind::CLASS_INSTANCE;
+
+// Объект-значение, хранящий значение типа T
+template <typename T>
+class ValueObject : public Object {
+public:
+    ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : Object(KIND_OF<ValueObject>)
+        , value_(v) {
+    }
+
+    void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
+        os << value_;
+    }
+
+    [[nodiscard]] const T& GetValue() const {
+        return value_;
+    }
+
+protected:
+    ValueObject(T v, ObjectKind kind)
+        : Object(kind)
+        , value_(v) {
+    }
+
+private:
+    T value_;
 };
 
-// Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе
+// Строковое значение
+using String = ValueObject<std::string>;
+// Числовое значение
+using Number = ValueObject<int>;
+
+// Логическое значение
+class Bool : public ValueObject<bool> {
+public:
+    Bool(bool v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : ValueObject<bool>(v, ObjectKind::BOOL) {
+    }
+
+    void Print(std::ostream& os, Context& context) override;
+};
+
+/*
+Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе.
+Числа и логические значения хранятся в самом ObjectHolder и не требуют памяти в куче,
+остальные объекты размещаются в куче, и ObjectHolder владеет ими через их счётчик ссылок.
+Указатели, полученные через Get и TryAs для чисел и логических значений, действительны,
+пока жив и не изменён этот ObjectHolder
+*/
 class ObjectHolder {
 public:
     // Создаёт пустое значение
     ObjectHolder() = default;
 
+    ObjectHolder(const ObjectHolder& other) = default;
+    ObjectHolder& operator=(const ObjectHolder& other) = default;
+
+    // ObjectHolder после перемещения из него становится пустым
+    ObjectHolder(ObjectHolder&& other) noexcept
+        : value_(std::move(other.value_)) {
+        other.Reset();
+    }
+
+    ObjectHolder& operator=(ObjectHolder&& other) noexcept {
+        if (this != &other) {
+            value_ = std::move(other.value_);
+            other.Reset();
+        }
+        return *this;
+    }
+
+    ~ObjectHolder() = default;
+
     // Возвращает ObjectHolder, владеющий объектом типа T
     // Тип T - конкретный класс-наследник Object.
-    // object копируется или перемещается в кучу
+    // Number и Bool копируются в сам ObjectHolder, остальные объекты копируются
+    // или перемещаются в кучу
     template <typename T>
     [[nodiscard]] static ObjectHolder Own(T&& object) {
-        return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
+        using Type = std::decay_t<T>;
+        if constexpr (std::is_same_v<Type, Number> || std::is_same_v<Type, Bool>) {
+            return ObjectHolder(Storage(std::in_place_type<Type>, std::forward<T>(object)));
+        } else {
+            return ObjectHolder(Storage(Ref(new Type(std::forward<T>(object)))));
+        }
+    }
+
+    // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки).
+    // Ни память, ни счётчик ссылок объекта при этом не затрагиваются
+    [[nodiscard]] static ObjectHolder Share(Object& object) {
+        return ObjectHolder(Storage(Borrowed{&object}));
     }
 
-    // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки)
-    [[nodiscard]] static ObjectHolder Share(Object& object);
     // Создаёт пустой ObjectHolder, соответствующий значению None
     [[nodiscard]] static ObjectHolder None();
 
+    // Делает невладеющую ссылку на объект, созданный через Own, владеющей. Так значение,
+    // которое уходит из метода (например, return self), не переживает свой объект.
+    // Ссылка на объект, которым не владеет ни один ObjectHolder (например, на объект на стеке),
+    // остаётся невладеющей: временем жизни такого объекта управляет создавший его код
+    void Retain() {
+        if (auto* borrowed = std::get_if<BORROWED_INDEX>(&value_);
+            borrowed != nullptr && borrowed->object->HasOwners()) {
+            Object* object = borrowed->object;
+            value_.emplace<OWNED_INDEX>(object);
+        }
+    }
+
     // Возвращает ссылку на Object внутри ObjectHolder.
     // ObjectHolder должен быть непустым
     Object& operator*() const;
 
     Object* operator->() const;
 
-    [[nodiscard]] Object* Get() const;
+    [[nodiscard]] Object* Get() const {
+        switch (value_.index()) {
+            case OWNED_INDEX:
+                return std::get_if<OWNED_INDEX>(&value_)->Get();
+            case BORROWED_INDEX:
+                return std::get_if<BORROWED_INDEX>(&value_)->object;
+            case NUMBER_INDEX:
+                return std::get_if<NUMBER_INDEX>(&value_);
+            default:
+                return std::get_if<BOOL_INDEX>(&value_);
+        }
+    }
 
     // Возвращает указатель на объект типа T либо nullptr, если внутри ObjectHolder не хранится
-    // объект данного типа
+    // объект данного типа. Встроенные типы проверяются по виду объекта, остальные - dynamic_cast
     template <typename T>
     [[nodiscard]] T* TryAs() const {
-        return dynamic_cast<T*>(this->Get());
+        Object* data = this->Get();
+        if constexpr (KIND_OF<T> != ObjectKind::OTHER) {
+            return data != nullptr && data->GetKind() == KIND_OF<T> ? static_cast<T*>(data)
+                                                                     : nullptr;
+        } else {
+            return dynamic_cast<T*>(data);
+        }
     }
 
     // Возвращает true, если ObjectHolder не пуст
-    explicit operator bool() const;
+    explicit operator bool() const {
+        return Get() != nullptr;
+    }
 
 private:
-    explicit ObjectHolder(std::shared_ptr<Object> data);
+    // Владеющая ссылка на объект в куче. Пустая ссылка - значение None
+    class Ref {
+    public:
+        Ref() noexcept
+            : object_(nullptr) {
+        }
+
+        explicit Ref(Object* object) noexcept
+            : object_(object) {
+            object_->AddRef();
+        }
+
+        Ref(const Ref& other) noexcept
+            : object_(other.object_) {
+            if (object_ != nullptr) {
+                object_->AddRef();
+            }
+        }
+
+        Ref(Ref&& other) noexcept
+            : object_(std::exchange(other.object_, nullptr)) {
+        }
+
+        Ref& operator=(const Ref& other) noexcept {
+            Ref copy(other);
+            std::swap(object_, copy.object_);
+            return *this;
+        }
+
+        Ref& operator=(Ref&& other) noexcept {
+            Ref moved(std::move(other));
+            std::swap(object_, moved.object_);
+            return *this;
+        }
+
+        ~Ref() {
+            if (object_ != nullptr && object_->Release()) {
+                delete object_;
+            }
+        }
+
+        [[nodiscard]] Object* Get() const noexcept {
+            return object_;
+        }
+
+    private:
+        Object* object_;
+    };
+
+    // Невладеющая ссылка, см. Share
+    struct Borrowed {
+        Object* object;
+    };
+
+    using Storage = std::variant<Ref, Borrowed, Number, Bool>;
+    static constexpr size_t OWNED_INDEX = 0;
+    static constexpr size_t BORROWED_INDEX = 1;
+    static constexpr size_t NUMBER_INDEX = 2;
+    static constexpr size_t BOOL_INDEX = 3;
+
+    explicit ObjectHolder(Storage value)
+        : value_(std::move(value)) {
+    }
+
+    void Reset() {
+        if (value_.index() != OWNED_INDEX) {
+            value_.emplace<OWNED_INDEX>();
+        }
+    }
+
     void AssertIsValid() const;
 
-    std::shared_ptr<Object> data_;
+    // Число или логическое значение внутри ObjectHolder - такой же объект, на который он
+    // указывает, как и объект в куче: константность ObjectHolder на него не распространяется
+    mutable Storage value_;
 };
 
-// Объект-значение, хранящий значение типа T
-template <typename T>
-class ValueObject : public Object {
+// Контекст исполнения инструкций Mython
+class Context {
 public:
-    ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : value_(v) {
+    // Возвращает поток вывода для команд print
+    virtual std::ostream& GetOutputStream() = 0;
+
+    // Инструкция return не бросает исключение, а запоминает значение и взводит признак
+    // возврата. Пока признак взведён, Compound не выполняет следующие инструкции.
+    // Тело метода забирает значение через TakeReturnValue, сбрасывая признак.
+    // Невладеющая ссылка в значении становится владеющей (см. ObjectHolder::Retain)
+    void SetReturnValue(ObjectHolder value);
+    ObjectHolder TakeReturnValue();
+
+    [[nodiscard]] bool IsReturning() const {
+        return returning_;
     }
 
-    void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
-        os << value_;
+    // Ячейки локальных переменных тела метода, которое сейчас выполняется (см. ast::MethodBody).
+    // Пустая ячейка - переменной ещё не присвоено значение. Вне метода и в телах,
+    // переменные которых ищутся в Closure по имени, кадр не используется
+    [[nodiscard]] std::optional<ObjectHolder>* GetFrame() const {
+        return frame_;
     }
 
-    [[nodiscard]] const T& GetValue() const {
-        return value_;
+    // Делает frame кадром выполняемого метода и возвращает прежний кадр
+    std::optional<ObjectHolder>* SetFrame(std::optional<ObjectHolder>* frame) {
+        std::swap(frame, frame_);
+        return frame;
     }
 
+protected:
+    ~Context() = default;
+
 private:
-    T value_;
+    ObjectHolder return_value_;
+    bool returning_ = false;
+    std::optional<ObjectHolder>* frame_ = nullptr;
 };
 
 // Таблица символов, связывающая имя объекта с его значением
@@ -105,20 +400,43 @@ public:
     // Выполняет действие над объектами внутри closure, используя context
     // Возвращает результирующее значение либо None
     virtual ObjectHolder Execute(Closure& closure, Context& context) = 0;
+
+    // Выполняет действие как тело метода объекта self: параметрам formal_params
+    // сопоставляются значения actual_args. По умолчанию создаёт Closure с именами self
+    // и formal_params и вызывает Execute
+    virtual ObjectHolder ExecuteMethod(const std::vector<std::string>& formal_params,
+                                       const ObjectHolder& self,
+                                       const std::vector<ObjectHolder>& actual_args,
+                                       Context& context);
+
+    // Функция, которой ForEachChild передаёт дочерние инструкции. Через ссылку
+    // дочернюю инструкцию можно заменить другой
+    using ChildVisitor = std::function<void(std::unique_ptr<Executable>& child)>;
+
+    // Вызывает visit для каждой дочерней инструкции в порядке их вычисления, включая
+    // пустые (например, отсутствующую ветку else). По умолчанию дочерних инструкций нет
+    virtual void ForEachChild(const ChildVisitor& /*visit*/) {
+    }
 };
 
-// Строковое значение
-using String = ValueObject<std::string>;
-// Числовое значение
-using Number = ValueObject<int>;
+// Номер имени метода. Имена получают номера при первом упоминании и сохраняют их
+// до конца работы программы, поэтому одноимённые методы всех классов имеют один номер
+using MethodId = std::uint32_t;
 
-// Логическое значение
-class Bool : public ValueObject<bool> {
-public:
-    using ValueObject<bool>::ValueObject;
+// Специальные методы получают номера заранее, и интерпретатор обращается к ним без поиска имени
+inline constexpr MethodId INIT_METHOD_ID = 0;
+inline constexpr MethodId STR_METHOD_ID = 1;
+inline constexpr MethodId EQ_METHOD_ID = 2;
+inline constexpr MethodId LT_METHOD_ID = 3;
+inline constexpr MethodId ADD_METHOD_ID = 4;
 
-    void Print(std::ostream& os, Context& context) override;
-};
+// Возвращает номер имени метода name, при первом упоминании назначая новый.
+// Функцию можно вызывать из нескольких потоков одновременно
+MethodId InternMethodName(const std::string& name);
+
+// Возвращает номер имени метода name либо std::nullopt, если такое имя ещё не упоминалось.
+// В отличие от InternMethodName, новых номеров не назначает
+std::optional<MethodId> FindMethodName(const std::string& name);
 
 // Метод класса
 struct Method {
@@ -130,6 +448,154 @@ struct Method {
     std::unique_ptr<Executable> body;
 };
 
+/*
+Форма объекта: имена полей в порядке их добавления. Поле с номером i хранится в ячейке i
+экземпляра, поэтому объекты, получившие одни и те же поля в одном порядке, разделяют одну форму.
+Добавление поля - переход к дочерней форме. Переход создаётся при первом добавлении
+и дальше переиспользуется. Формы образуют дерево с корнем в классе и живут, пока жив класс
+*/
+class Shape {
+public:
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+    Shape() = default;
+    Shape(const Shape&) = delete;
+    Shape& operator=(const Shape&) = delete;
+
+    // Возвращает номер ячейки поля name либо NOT_FOUND, если такого поля нет
+    [[nodiscard]] size_t Find(const std::string& name) const;
+
+    // Возвращает форму, получающуюся добавлением поля name, которого ещё нет в этой форме
+    [[nodiscard]] const Shape& With(const std::string& name) const;
+
+    // Возвращает число полей
+    [[nodiscard]] size_t Size() const {
+        return names_.size();
+    }
+
+    // Возвращает имя поля в ячейке slot
+    [[nodiscard]] const std::string& NameAt(size_t slot) const {
+        return names_[slot];
+    }
+
+private:
+    // Начиная с этого числа полей имена ищутся через index_, а не перебором
+    static constexpr size_t INDEX_THRESHOLD = 8;
+
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, size_t> index_;
+    mutable std::vector<std::pair<std::string, std::unique_ptr<Shape>>> transitions_;
+};
+
+/*
+Поля экземпляра класса. Значения лежат в ячейках с номерами из формы объекта:
+первые INLINE_SLOTS - в самой таблице, остальные - в отдельном массиве.
+Для совместимости с Closure таблица поддерживает operator[], at, find и count по имени.
+Ссылки на ячейки остаются действительными только до добавления следующего поля
+*/
+class FieldTable {
+public:
+    static constexpr size_t INLINE_SLOTS = 4;
+
+    // Итератор по полям в порядке ячеек. Разыменование даёт пару (имя, значение)
+    template <typename Table, typename Value>
+    class BasicIterator {
+    public:
+        using value_type = std::pair<const std::string&, Value&>;
+
+        BasicIterator(Table& table, size_t slot)
+            : table_(&table)
+            , slot_(slot) {
+        }
+
+        value_type operator*() const {
+            return {table_->GetShape().NameAt(slot_), table_->Slot(slot_)};
+        }
+
+        BasicIterator& operator++() {
+            ++slot_;
+            return *this;
+        }
+
+        bool operator==(const BasicIterator& other) const {
+            return table_ == other.table_ && slot_ == other.slot_;
+        }
+
+        bool operator!=(const BasicIterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Table* table_;
+        size_t slot_;
+    };
+
+    using iterator = BasicIterator<FieldTable, ObjectHolder>;
+    using const_iterator = BasicIterator<const FieldTable, const ObjectHolder>;
+
+    // Создаёт таблицу без полей с формой shape
+    explicit FieldTable(const Shape& shape)
+        : shape_(&shape) {
+    }
+
+    [[nodiscard]] const Shape& GetShape() const {
+        return *shape_;
+    }
+
+    // Возвращает значение в ячейке slot текущей формы
+    [[nodiscard]] ObjectHolder& Slot(size_t slot) {
+        return slot < INLINE_SLOTS ? inline_[slot] : outline_[slot - INLINE_SLOTS];
+    }
+
+    [[nodiscard]] const ObjectHolder& Slot(size_t slot) const {
+        return slot < INLINE_SLOTS ? inline_[slot] : outline_[slot - INLINE_SLOTS];
+    }
+
+    // Добавляет поле со значением None и переходит к форме next.
+    // next должна быть результатом GetShape().With(имя поля)
+    ObjectHolder& Append(const Shape& next);
+
+    // Возвращает значение поля name, добавляя поле со значением None, если его нет
+    ObjectHolder& operator[](const std::string& name);
+
+    // Возвращает значение поля name. Если поля нет, выбрасывает out_of_range
+    [[nodiscard]] ObjectHolder& at(const std::string& name);
+    [[nodiscard]] const ObjectHolder& at(const std::string& name) const;
+
+    [[nodiscard]] iterator find(const std::string& name);
+    [[nodiscard]] const_iterator find(const std::string& name) const;
+    [[nodiscard]] size_t count(const std::string& name) const;
+
+    [[nodiscard]] iterator begin() {
+        return {*this, 0};
+    }
+
+    [[nodiscard]] iterator end() {
+        return {*this, size()};
+    }
+
+    [[nodiscard]] const_iterator begin() const {
+        return {*this, 0};
+    }
+
+    [[nodiscard]] const_iterator end() const {
+        return {*this, size()};
+    }
+
+    [[nodiscard]] size_t size() const {
+        return shape_->Size();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    const Shape* shape_;
+    std::array<ObjectHolder, INLINE_SLOTS> inline_;
+    std::vector<ObjectHolder> outline_;
+};
+
 // Класс
 class Class : public Object {
 public:
@@ -137,20 +603,67 @@ public:
     // Если parent равен nullptr, то создаётся базовый класс
     explicit Class(std::string name, std::vector<Method> methods, const Class* parent);
 
-    // Возвращает указатель на метод name или nullptr, если метод с таким именем отсутствует
+    // Возвращает указатель на метод name, объявленный в самом классе или в ближайшем
+    // из предков, либо nullptr, если метода с таким именем нет
     [[nodiscard]] const Method* GetMethod(const std::string& name) const;
 
+    // Возвращает метод с номером имени id, принимающий arity параметров, либо nullptr.
+    // Это тот же метод, что находит GetMethod(name), если у него arity параметров:
+    // метод класса скрывает унаследованные методы с тем же именем и другим числом параметров
+    [[nodiscard]] const Method* GetMethod(MethodId id, size_t arity) const {
+        const std::uint64_t key = MethodKey(id, arity);
+        for (size_t slot = SlotOf(key);; slot = (slot + 1) & (methods_table_.size() - 1)) {
+            const TableEntry& entry = methods_table_[slot];
+            if (entry.method == nullptr || entry.key == key) {
+                return entry.method;
+            }
+        }
+    }
+
     // Возвращает имя класса
     [[nodiscard]] const std::string& GetName() const;
 
+    // Возвращает родительский класс или nullptr, если класс базовый
+    [[nodiscard]] const Class* GetParent() const;
+
+    // Возвращает методы, объявленные в самом классе (без унаследованных)
+    [[nodiscard]] std::vector<const Method*> GetOwnMethods() const;
+
+    // Возвращает форму новых экземпляров класса, ещё не получивших полей
+    [[nodiscard]] const Shape& GetRootShape() const;
+
     // Выводит в os строку "Class <имя класса>", например "Class cat"
     void Print(std::ostream& os, Context& context) override;
 
 private:
+    // Ячейка таблицы методов: ключ из номера имени и числа параметров и сам метод.
+    // У пустой ячейки method равен nullptr
+    struct TableEntry {
+        std::uint64_t key = 0;
+        const Method* method = nullptr;
+    };
+
+    static std::uint64_t MethodKey(MethodId id, size_t arity) {
+        return (static_cast<std::uint64_t>(id) << 32) | static_cast<std::uint32_t>(arity);
+    }
+
+    size_t SlotOf(std::uint64_t key) const {
+        const std::uint64_t hash = (key * 0x9E3779B97F4A7C15ull) >> 32;
+        return static_cast<size_t>(hash) & (methods_table_.size() - 1);
+    }
+
+    void BuildMethodsTable();
+
     std::string name_;
     std::unordered_map<std::string, Method> methods_;
-    std::unordered_map<std::string, const Method*> methods_ptr_;
-    const Class*& parent_;
+    // Собственные и унаследованные методы по номеру имени и числу параметров: хеш-таблица
+    // с открытой адресацией, заполненная не больше чем наполовину. Строится в конструкторе
+    // из ячеек таблицы родителя, поэтому поиск не зависит от глубины иерархии, а размер -
+    // от числа имён методов в процессе
+    std::vector<TableEntry> methods_table_;
+    const Class* parent_;
+    // Формы хранятся отдельно, чтобы их адреса не менялись при перемещении класса
+    std::unique_ptr<Shape> root_shape_;
 };
 
 // Экземпляр класса
@@ -173,17 +686,30 @@ public:
     ObjectHolder Call(const std::string& method, const std::vector<ObjectHolder>& actual_args,
                       Context& context);
 
+    // Вызывает метод с номером имени method
+    ObjectHolder Call(MethodId method, const std::vector<ObjectHolder>& actual_args,
+                      Context& context);
+
+    // Вызывает метод method, заранее найденный в классе объекта (например, через MethodCache).
+    // Если method равен nullptr или число параметров не совпадает, выбрасывает runtime_error
+    ObjectHolder Call(const Method* method, const std::vector<ObjectHolder>& actual_args,
+                      Context& context);
+
     // Возвращает true, если объект имеет метод method, принимающий argument_count параметров
     [[nodiscard]] bool HasMethod(const std::string& method, size_t argument_count) const;
+    [[nodiscard]] bool HasMethod(MethodId method, size_t argument_count) const;
+
+    // Возвращает ссылку на таблицу полей объекта
+    [[nodiscard]] FieldTable& Fields();
+    // Возвращает константную ссылку на таблицу полей объекта
+    [[nodiscard]] const FieldTable& Fields() const;
 
-    // Возвращает ссылку на Closure, содержащий поля объекта
-    [[nodiscard]] Closure& Fields();
-    // Возвращает константную ссылку на Closure, содержащую поля объекта
-    [[nodiscard]] const Closure& Fields() const;
+    // Возвращает класс объекта
+    [[nodiscard]] const Class& GetClass() const;
 
 private:
     const Class& class_;
-    Closure closure_;
+    FieldTable fields_;
 };
 
 /*
@@ -1,6 +1,9 @@
+#include "allocation_counter.h"
+#include "field_cache.h"
 #include "runtime.h"
 
 #include <functional>
+#include <stdexcept>
 #include <test_runner.h>
 
 using namespace std;
@@ -19,13 +22,15 @@ public:
     }
 
     Logger(const Logger& rhs)
-        : id_(rhs.id_)  //
+        : Object(rhs)
+        , id_(rhs.id_)  //
     {
         ++instance_count;
     }
 
     Logger(Logger&& rhs) noexcept
-        : id_(rhs.id_)  //
+        : Object(rhs)
+        , id_(rhs.id_)  //
     {
         ++instance_count;
     }
@@ -180,6 +185,65 @@ void TestMethodInvocation() {
     ASSERT_THROWS(child_inst.Call("test"s, {ObjectHolder::None()}, context), runtime_error);
 }
 
+void TestDeepInheritance() {
+    DummyContext context;
+    auto returns = [](int value) {
+        return make_unique<TestMethodBody>([value](Closure&, Context&) {
+            return ObjectHolder::Own(Number{value});
+        });
+    };
+
+    // Level0 объявляет root() и m0()..m19(), чётные уровни объявляют who(),
+    // а Level3 объявляет root(x)
+    vector<unique_ptr<Class>> levels;
+    for (int level = 0; level < 6; ++level) {
+        vector<Method> methods;
+        if (level == 0) {
+            methods.push_back({"root"s, {}, returns(100)});
+            for (int i = 0; i < 20; ++i) {
+                methods.push_back({"m"s + to_string(i), {}, returns(i)});
+            }
+        }
+        if (level % 2 == 0) {
+            methods.push_back({"who"s, {}, returns(level)});
+        }
+        if (level == 3) {
+            methods.push_back({"root"s, {"x"s}, returns(103)});
+        }
+        const Class* parent = levels.empty() ? nullptr : levels.back().get();
+        levels.push_back(make_unique<Class>("Level"s + to_string(level), move(methods), parent));
+    }
+
+    // Метод прадеда находится так же, как собственный
+    ClassInstance second{*levels[2]};
+    ASSERT(second.HasMethod("root"s, 0));
+    ASSERT_EQUAL(levels[2]->GetMethod("root"s), levels[0]->GetMethod("root"s));
+    ASSERT_EQUAL(second.Call("root"s, {}, context).TryAs<Number>()->GetValue(), 100);
+
+    ClassInstance last{*levels[5]};
+    ASSERT_EQUAL(last.Call("who"s, {}, context).TryAs<Number>()->GetValue(), 4);
+    ASSERT_EQUAL(last.Call("m13"s, {}, context).TryAs<Number>()->GetValue(), 13);
+    // Метод наследника скрывает унаследованный метод с тем же именем при любом числе параметров
+    ASSERT(!last.HasMethod("root"s, 0));
+    ASSERT(last.HasMethod(InternMethodName("root"s), 1));
+    ASSERT(!last.HasMethod("root"s, 2));
+    ASSERT_EQUAL(levels[5]->GetMethod("root"s), levels[3]->GetMethod("root"s));
+    ASSERT_EQUAL(levels[5]->GetMethod(InternMethodName("root"s), 1), levels[5]->GetMethod("root"s));
+    ASSERT_EQUAL(levels[5]->GetMethod(InternMethodName("root"s), 0), nullptr);
+    ASSERT_THROWS(last.Call("root"s, {}, context), runtime_error);
+    ASSERT_EQUAL(last.Call("root"s, {ObjectHolder::None()}, context).TryAs<Number>()->GetValue(),
+                 103);
+    // Выше по иерархии root() по-прежнему виден
+    ASSERT_EQUAL(second.Call("root"s, {}, context).TryAs<Number>()->GetValue(), 100);
+    ASSERT_EQUAL(levels[5]->GetMethod("missing"s), nullptr);
+
+    // Поиск по имени не назначает номеров новым именам
+    ASSERT(!last.HasMethod("never_declared"s, 0));
+    ASSERT_THROWS(last.Call("never_declared"s, {}, context), runtime_error);
+    ASSERT(!FindMethodName("never_declared"s).has_value());
+    ASSERT_EQUAL(InternMethodName("__init__"s), INIT_METHOD_ID);
+}
+
 void TestNonowning() {
     ASSERT_EQUAL(Logger::instance_count, 0);
     Logger logger(784);
@@ -529,6 +593,148 @@ void TestClassInstance() {
     ASSERT_THROWS(instance.Call("missing_method"s, {}, ctx), runtime_error);
 }
 
+void TestShapes() {
+    Class cls{"Point"s, {}, nullptr};
+    ClassInstance first{cls};
+    ClassInstance second{cls};
+    ClassInstance reversed{cls};
+    ASSERT_EQUAL(&first.Fields().GetShape(), &cls.GetRootShape());
+
+    first.Fields()["x"s] = ObjectHolder::Own(Number{1});
+    first.Fields()["y"s] = ObjectHolder::Own(Number{2});
+    reversed.Fields()["y"s] = ObjectHolder::Own(Number{3});
+    reversed.Fields()["x"s] = ObjectHolder::Own(Number{4});
+
+    {
+        // Объект, получающий поля в уже известном порядке, не создаёт форм и не выделяет память
+        AllocationCounter allocations;
+        FieldCache cache;
+        cache.Insert(second.Fields(), "x"s) = ObjectHolder::Own(Number{5});
+        second.Fields()["y"s] = ObjectHolder::Own(Number{6});
+        const size_t allocated = allocations.Count();
+        ASSERT_EQUAL(allocated, 0U);
+        // Объекты одной формы находят поле через одну запись кэша
+        ASSERT(cache.Find(second.Fields(), "x"s) == &second.Fields().Slot(0));
+        ASSERT(cache.Find(first.Fields(), "x"s) == &first.Fields().Slot(0));
+        ASSERT_EQUAL(cache.Hits(), 1U);
+    }
+    ASSERT_EQUAL(&first.Fields().GetShape(), &second.Fields().GetShape());
+    ASSERT(&first.Fields().GetShape() != &reversed.Fields().GetShape());
+    ASSERT_EQUAL(first.Fields().GetShape().Find("y"s), 1U);
+    ASSERT_EQUAL(reversed.Fields().GetShape().Find("y"s), 0U);
+    ASSERT_EQUAL(reversed.Fields().at("x"s).TryAs<Number>()->GetValue(), 4);
+    ASSERT(first.Fields().find("z"s) == first.Fields().end());
+    ASSERT_EQUAL(first.Fields().count("z"s), 0U);
+    ASSERT_THROWS(static_cast<void>(first.Fields().at("z"s)), out_of_range);
+
+    // Поля сверх встроенных ячеек и сверх порога индекса ищутся так же
+    ClassInstance wide{cls};
+    for (int i = 0; i < 12; ++i) {
+        wide.Fields()["f"s + to_string(i)] = ObjectHolder::Own(Number{i});
+    }
+    ASSERT_EQUAL(wide.Fields().size(), 12U);
+    int expected = 0;
+    for (const auto [name, value] : wide.Fields()) {
+        ASSERT_EQUAL(name, "f"s + to_string(expected));
+        ASSERT_EQUAL(value.TryAs<Number>()->GetValue(), expected);
+        ++expected;
+    }
+    ASSERT_EQUAL(wide.Fields().at("f11"s).TryAs<Number>()->GetValue(), 11);
+}
+
+void TestTryAs() {
+    Class cls{"Test"s, {}, nullptr};
+    const ObjectHolder number = ObjectHolder::Own(Number{1});
+    const ObjectHolder str = ObjectHolder::Own(String{"a"s});
+    const ObjectHolder boolean = ObjectHolder::Own(Bool{true});
+    const ObjectHolder instance = ObjectHolder::Own(ClassInstance{cls});
+    const ObjectHolder logger = ObjectHolder::Own(Logger{5});
+
+    ASSERT(number->GetKind() == ObjectKind::NUMBER);
+    ASSERT(str->GetKind() == ObjectKind::STRING);
+    ASSERT(boolean->GetKind() == ObjectKind::BOOL);
+    ASSERT(cls.GetKind() == ObjectKind::CLASS);
+    ASSERT(instance->GetKind() == ObjectKind::CLASS_INSTANCE);
+    ASSERT(logger->GetKind() == ObjectKind::OTHER);
+
+    ASSERT_EQUAL(number.TryAs<Number>(), number.Get());
+    ASSERT_EQUAL(str.TryAs<String>(), str.Get());
+    ASSERT_EQUAL(boolean.TryAs<Bool>(), boolean.Get());
+    ASSERT_EQUAL(instance.TryAs<ClassInstance>(), instance.Get());
+    ASSERT_EQUAL(ObjectHolder::Share(cls).TryAs<Class>(), &cls);
+
+    ASSERT(number.TryAs<String>() == nullptr);
+    ASSERT(str.TryAs<Number>() == nullptr);
+    ASSERT(boolean.TryAs<Number>() == nullptr);
+    ASSERT(instance.TryAs<Class>() == nullptr);
+    ASSERT(logger.TryAs<Number>() == nullptr);
+    ASSERT(ObjectHolder::None().TryAs<Number>() == nullptr);
+
+    // Прочие типы по-прежнему проверяются через dynamic_cast
+    ASSERT(logger.TryAs<Logger>() != nullptr && logger.TryAs<Logger>()->GetId() == 5);
+    ASSERT(number.TryAs<Logger>() == nullptr);
+}
+
+void TestImmediateValues() {
+    AllocationCounter allocations;
+    ObjectHolder number = ObjectHolder::Own(Number{5});
+    ObjectHolder boolean = ObjectHolder::Own(Bool{true});
+    ObjectHolder copy = number;
+    ObjectHolder moved = std::move(boolean);
+    copy = ObjectHolder::Own(Number{6});
+    const bool is_true = IsTrue(moved);
+
+    // Числа и логические значения хранятся в самом ObjectHolder
+    const size_t allocated = allocations.Count();
+    ASSERT_EQUAL(allocated, 0U);
+    ASSERT(is_true);
+    ASSERT_EQUAL(number.TryAs<Number>()->GetValue(), 5);
+    ASSERT_EQUAL(copy.TryAs<Number>()->GetValue(), 6);
+    ASSERT(moved.TryAs<Bool>() != nullptr && moved.TryAs<Bool>()->GetValue());
+    ASSERT(!boolean);  // NOLINT
+
+    const size_t before_string = allocations.Count();
+    const ObjectHolder str = ObjectHolder::Own(String{"a"s});
+    ASSERT(allocations.Count() > before_string);
+    ASSERT_EQUAL(str.TryAs<String>()->GetValue(), "a"s);
+}
+
+void TestReferenceCounting() {
+    ASSERT_EQUAL(Logger::instance_count, 0);
+    Logger logger(1);
+    {
+        // Невладеющая ссылка не выделяет память и не удаляет объект
+        AllocationCounter allocations;
+        ObjectHolder shared = ObjectHolder::Share(logger);
+        ObjectHolder copy = shared;
+        const size_t allocated = allocations.Count();
+        ASSERT_EQUAL(allocated, 0U);
+        ASSERT(copy.Get() == &logger);
+    }
+    ASSERT_EQUAL(Logger::instance_count, 1);
+
+    {
+        // Объект в куче занимает одно выделение памяти вместе со счётчиком ссылок
+        AllocationCounter allocations;
+        ObjectHolder owner = ObjectHolder::Own(Logger(2));
+        const size_t allocated = allocations.Count();
+        ASSERT_EQUAL(allocated, 1U);
+        ASSERT_EQUAL(Logger::instance_count, 2);
+
+        ObjectHolder copy = owner;
+        owner = ObjectHolder::None();
+        ASSERT_EQUAL(Logger::instance_count, 2);
+        ASSERT_EQUAL(copy.TryAs<Logger>()->GetId(), 2);
+
+        // Копия объекта - отдельный объект со своим счётчиком
+        ObjectHolder duplicate = ObjectHolder::Own(Logger(*copy.TryAs<Logger>()));
+        copy = ObjectHolder::None();
+        ASSERT_EQUAL(Logger::instance_count, 2);
+        ASSERT_EQUAL(duplicate.TryAs<Logger>()->GetId(), 2);
+    }
+    ASSERT_EQUAL(Logger::instance_count, 1);
+}
+
 }  // namespace
 
 void RunObjectsTests(TestRunner& tr) {
@@ -536,10 +742,13 @@ void RunObjectsTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestString);
     RUN_TEST(tr, runtime::TestBool);
     RUN_TEST(tr, runtime::TestMethodInvocation);
+    RUN_TEST(tr, runtime::TestDeepInheritance);
     RUN_TEST(tr, runtime::TestIsTrue);
     RUN_TEST(tr, runtime::TestComparison);
     RUN_TEST(tr, runtime::TestClass);
     RUN_TEST(tr, runtime::TestClassInstance);
+    RUN_TEST(tr, runtime::TestShapes);
+    RUN_TEST(tr, runtime::TestTryAs);
 }
 
 void RunObjectHolderTests(TestRunner& tr) {
@@ -547,6 +756,8 @@ void RunObjectHolderTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestOwning);
     RUN_TEST(tr, runtime::TestMove);
     RUN_TEST(tr, runtime::TestNullptr);
+    RUN_TEST(tr, runtime::TestImmediateValues);
+    RUN_TEST(tr, runtime::TestReferenceCounting);
 }
 
 }  // namespace runtime
@@ -0,0 +1,212 @@
+#include "scan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MYTHON_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace parse::scan {
+
+namespace {
+
+size_t ScalarFindFirstNonSpace(const char* data, size_t size) {
+    size_t i = 0;
+    while (i < size && data[i] == ' ') {
+        ++i;
+    }
+    return i;
+}
+
+size_t ScalarFindStringEnd(const char* data, size_t size, char quote) {
+    for (size_t i = 0; i < size; ++i) {
+        const char ch = data[i];
+        if (ch == quote || ch == '\\' || ch == '\n' || ch == '\r') {
+            return i;
+        }
+    }
+    return size;
+}
+
+size_t ScalarFindLineEnd(const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] == '\n') {
+            return i;
+        }
+    }
+    return size;
+}
+
+#ifdef MYTHON_SCAN_X86
+
+// Векторные версии обрабатывают полные блоки по 16 (32) байт,
+// остаток строки досматривается скалярным кодом, чтобы не читать за границей буфера.
+// AVX2-версии не вызывают SSE2-версии: переход между VEX- и не-VEX-кодом
+// с «грязными» старшими половинами регистров обходится дороже самого поиска
+
+size_t Sse2FindFirstNonSpace(const char* data, size_t size) {
+    const __m128i space = _mm_set1_epi8(' ');
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, space))) & 0xFFFFu;
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + ScalarFindFirstNonSpace(data + i, size - i);
+}
+
+size_t Sse2FindStringEnd(const char* data, size_t size, char quote) {
+    const __m128i quote_v = _mm_set1_epi8(quote);
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage = _mm_set1_epi8('\r');
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote_v), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, carriage)));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + ScalarFindStringEnd(data + i, size - i, quote);
+}
+
+size_t Sse2FindLineEnd(const char* data, size_t size) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + ScalarFindLineEnd(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) size_t Avx2FindFirstNonSpace(const char* data, size_t size) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, space)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    if (i + 16 <= size) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(space)))) & 0xFFFFu;
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+    return i + ScalarFindFirstNonSpace(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) size_t Avx2FindStringEnd(const char* data, size_t size, char quote) {
+    const __m256i quote_v = _mm256_set1_epi8(quote);
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i carriage = _mm256_set1_epi8('\r');
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote_v), _mm256_cmpeq_epi8(chunk, backslash)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), _mm256_cmpeq_epi8(chunk, carriage)));
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    if (i + 16 <= size) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(quote_v)),
+                         _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(backslash))),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(newline)),
+                         _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(carriage))));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+    return i + ScalarFindStringEnd(data + i, size - i, quote);
+}
+
+__attribute__((target("avx2"))) size_t Avx2FindLineEnd(const char* data, size_t size) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    if (i + 16 <= size) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(newline))));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+    return i + ScalarFindLineEnd(data + i, size - i);
+}
+
+#endif  // MYTHON_SCAN_X86
+
+struct Kernels {
+    size_t (*find_first_non_space)(const char*, size_t);
+    size_t (*find_string_end)(const char*, size_t, char);
+    size_t (*find_line_end)(const char*, size_t);
+    string_view name;
+};
+
+Kernels SelectKernels() {
+#ifdef MYTHON_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {Avx2FindFirstNonSpace, Avx2FindStringEnd, Avx2FindLineEnd, "avx2"sv};
+    }
+    return {Sse2FindFirstNonSpace, Sse2FindStringEnd, Sse2FindLineEnd, "sse2"sv};
+#else
+    return {ScalarFindFirstNonSpace, ScalarFindStringEnd, ScalarFindLineEnd, "scalar"sv};
+#endif
+}
+
+// Выбор делается при первом обращении, а не при динамической инициализации глобальных объектов
+const Kernels& ActiveKernels() {
+    static const Kernels kernels = SelectKernels();
+    return kernels;
+}
+
+}  // namespace
+
+size_t FindFirstNonSpace(string_view text) {
+    return ActiveKernels().find_first_non_space(text.data(), text.size());
+}
+
+size_t FindStringEnd(string_view text, char quote) {
+    return ActiveKernels().find_string_end(text.data(), text.size(), quote);
+}
+
+size_t FindLineEnd(string_view text) {
+    return ActiveKernels().find_line_end(text.data(), text.size());
+}
+
+string_view ActiveKernelName() {
+    return ActiveKernels().name;
+}
+
+}  // namespace parse::scan
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Векторные примитивы поиска для лексера.
+// На x86-64 реализация (AVX2 или SSE2) выбирается один раз во время выполнения
+// по возможностям процессора, на остальных платформах используется скалярная версия.
+// Все функции возвращают индекс найденного символа либо text.size(), если он не найден
+namespace parse::scan {
+
+// Индекс первого символа, отличного от пробела
+size_t FindFirstNonSpace(std::string_view text);
+
+// Индекс первого символа quote, обратной косой черты, '\n' или '\r'
+size_t FindStringEnd(std::string_view text, char quote);
+
+// Индекс первого символа '\n'
+size_t FindLineEnd(std::string_view text);
+
+// Имя выбранной реализации: "avx2", "sse2" или "scalar"
+std::string_view ActiveKernelName();
+
+}  // namespace parse::scan
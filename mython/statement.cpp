@@ -1,5 +1,6 @@
 #include "statement.h"
 
+#include <array>
 #include <iostream>
 #include <exception>
 #include <sstream>
@@ -13,16 +14,50 @@ using runtime::Context;
 using runtime::ObjectHolder;
 
 namespace {
-const string ADD_METHOD = "__add__"s;
-const string INIT_METHOD = "__init__"s;
+// Специализация узла по типу значения, которое он увидел при первом вычислении
+Quickening Observe(const ObjectHolder& value) {
+  if (value.TryAs<runtime::Number>() != nullptr) {
+    return Quickening::NUMBERS;
+  }
+  if (value.TryAs<runtime::String>() != nullptr) {
+    return Quickening::STRINGS;
+  }
+  return Quickening::GENERIC;
+}
+
+// Кадры методов такого размера размещаются на стеке
+constexpr std::uint32_t INLINE_FRAME_SIZE = 8;
+
+// Делает frame кадром контекста до выхода из области видимости
+class FrameScope {
+public:
+  FrameScope(Context& context, std::optional<ObjectHolder>* frame)
+    : context_(context),
+      previous_(context.SetFrame(frame)) {
+  }
+
+  FrameScope(const FrameScope&) = delete;
+  FrameScope& operator=(const FrameScope&) = delete;
+
+  ~FrameScope() {
+    context_.SetFrame(previous_);
+  }
+
+private:
+  Context& context_;
+  std::optional<ObjectHolder>* previous_;
+};
 }  // namespace
 
 
 // Присваивает переменной, имя которой задано в параметре var, значение выражения rv
 ObjectHolder Assignment::Execute(Closure& closure, Context& context) {
-  closure[var_] = rv_.get()->Execute(closure, context);
-
-  return closure[var_];
+  // Значение вычисляется до вставки имени: rv может обращаться к ещё не объявленной var_
+  ObjectHolder value = rv_.get()->Execute(closure, context);
+  if (auto* frame = context.GetFrame(); slot_ != NO_SLOT && frame != nullptr) {
+    return *(frame[slot_] = std::move(value));
+  }
+  return closure[var_] = std::move(value);
 }
 
 Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv)
@@ -30,35 +65,50 @@ Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv)
     rv_ (std::move(rv)) {
 }
 
-VariableValue::VariableValue(const std::string& var_name) : var_name_(var_name) {
+void Assignment::ForEachChild(const ChildVisitor& visit) {
+  visit(rv_);
 }
 
-VariableValue::VariableValue(std::vector<std::string> dotted_ids) : dotted_ids_(std::move(dotted_ids)) {
+const std::string& Assignment::GetName() const {
+  return var_;
 }
 
-ObjectHolder VariableValue::Execute(Closure& closure, Context& context) {
-  if (!dotted_ids_.empty()) {
-    if(dotted_ids_.size() == 1)
-      return VariableValue(dotted_ids_.front()).Execute(closure, context);
-
+unique_ptr<Statement>& Assignment::GetValue() {
+  return rv_;
+}
 
-    auto first = dotted_ids_.front();
+const unique_ptr<Statement>& Assignment::GetValue() const {
+  return rv_;
+}
 
-    auto object = closure[first];
-    Closure& new_closure = object.TryAs<runtime::ClassInstance>()->Fields();
+void Assignment::SetSlot(std::uint32_t slot) {
+  slot_ = slot;
+}
 
+VariableValue::VariableValue(const std::string& var_name) : var_name_(var_name) {
+}
 
-    std::vector<std::string> new_dotted_ids;
+VariableValue::VariableValue(std::vector<std::string> dotted_ids)
+  : dotted_ids_(std::move(dotted_ids)),
+    field_caches_(dotted_ids_.empty() ? 0 : dotted_ids_.size() - 1) {
+}
 
-    for (int i = 1; i < static_cast<int>(dotted_ids_.size()); ++i) {
-      new_dotted_ids.push_back(dotted_ids_[i]);
+ObjectHolder VariableValue::Execute(Closure& closure, Context& context) {
+  if (auto* frame = context.GetFrame(); slot_ != NO_SLOT && frame != nullptr) {
+    const std::optional<ObjectHolder>& local = frame[slot_];
+    if (!local) {
+      throw std::runtime_error("VariableValue fail"s);
     }
-
-    return VariableValue(new_dotted_ids).Execute(new_closure, context);
+    return dotted_ids_.size() < 2 ? *local : ReadFields(*local);
   }
 
+  if (!dotted_ids_.empty()) {
+    if(dotted_ids_.size() == 1)
+      return VariableValue(dotted_ids_.front()).Execute(closure, context);
 
-
+    // Промежуточные объекты цепочки, которых ещё нет, создаются со значением None
+    return ReadFields(closure[dotted_ids_.front()]);
+  }
 
   if (closure.count(var_name_)) {
     return closure[var_name_];
@@ -68,6 +118,36 @@ ObjectHolder VariableValue::Execute(Closure& closure, Context& context) {
   throw std::runtime_error("VariableValue fail"s);
 }
 
+ObjectHolder VariableValue::ReadFields(ObjectHolder object) {
+  for (size_t i = 1; i < dotted_ids_.size(); ++i) {
+    auto* instance = object.TryAs<runtime::ClassInstance>();
+    if (instance == nullptr) {
+      throw std::runtime_error("VariableValue fail"s);
+    }
+    runtime::FieldCache& cache = field_caches_[i - 1];
+    if (i + 1 < dotted_ids_.size()) {
+      // Копия берётся до присваивания: object может быть последней ссылкой на instance
+      ObjectHolder field = cache.Insert(instance->Fields(), dotted_ids_[i]);
+      object = std::move(field);
+    } else if (const ObjectHolder* field = cache.Find(instance->Fields(), dotted_ids_[i])) {
+      return *field;
+    }
+  }
+  throw std::runtime_error("VariableValue fail"s);
+}
+
+const std::string& VariableValue::GetName() const {
+  return dotted_ids_.empty() ? var_name_ : dotted_ids_.front();
+}
+
+const vector<std::string>& VariableValue::GetDottedIds() const {
+  return dotted_ids_;
+}
+
+void VariableValue::SetSlot(std::uint32_t slot) {
+  slot_ = slot;
+}
+
 unique_ptr<Print> Print::Variable(const std::string& name) {
   Print print;
   print.SetName(name);
@@ -128,10 +208,33 @@ ObjectHolder Print::Execute(Closure& closure, Context& context) {
   return {};
 }
 
+void Print::ForEachChild(const ChildVisitor& visit) {
+  if (auto* args = get_if<vector<unique_ptr<Statement>>>(&value_)) {
+    for (auto& arg : *args) {
+      visit(arg);
+    }
+  } else {
+    visit(get<unique_ptr<Statement>>(value_));
+  }
+}
+
+const std::string& Print::GetName() const {
+  return name_;
+}
+
+Print::Arguments& Print::GetArguments() {
+  return value_;
+}
+
+const Print::Arguments& Print::GetArguments() const {
+  return value_;
+}
+
 MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method,
                        std::vector<std::unique_ptr<Statement>> args)
 : object_(std::move(object)),
 method_(std::move(method)) ,
+method_id_(runtime::InternMethodName(method_)),
 args_(std::move(args)) {
 }
 
@@ -144,13 +247,68 @@ ObjectHolder MethodCall::Execute(Closure& closure, Context& context) {
   }
 
 
-  return object_.get()->Execute(closure, context).TryAs<runtime::ClassInstance>()->Call(method_, args, context);
+  const ObjectHolder object = object_.get()->Execute(closure, context);
+  auto* instance = object.TryAs<runtime::ClassInstance>();
+  if (instance == nullptr) {
+    throw runtime_error("MethodCall fail"s);
+  }
+  return instance->Call(cache_.Find(instance->GetClass(), method_id_, args.size()), args, context);
+}
+
+const runtime::MethodCache& MethodCall::GetCache() const {
+  return cache_;
+}
+
+void MethodCall::ForEachChild(const ChildVisitor& visit) {
+  visit(object_);
+  for (auto& arg : args_) {
+    visit(arg);
+  }
+}
+
+unique_ptr<Statement>& MethodCall::GetObject() {
+  return object_;
+}
+
+const unique_ptr<Statement>& MethodCall::GetObject() const {
+  return object_;
+}
+
+const std::string& MethodCall::GetMethod() const {
+  return method_;
+}
+
+runtime::MethodId MethodCall::GetMethodId() const {
+  return method_id_;
+}
+
+vector<unique_ptr<Statement>>& MethodCall::GetArgs() {
+  return args_;
+}
+
+const vector<unique_ptr<Statement>>& MethodCall::GetArgs() const {
+  return args_;
 }
 
 ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
-  string result;
+  const ObjectHolder arg = GetArgument().get()->Execute(closure, context);
+
+  if (quickening_ == Quickening::NUMBERS) {
+    if (auto* number = arg.TryAs<runtime::Number>()) {
+      return ObjectHolder::Own(runtime::String(std::to_string(number->GetValue())));
+    }
+  } else if (quickening_ == Quickening::STRINGS) {
+    if (auto* str = arg.TryAs<runtime::String>()) {
+      return ObjectHolder::Own(runtime::String(str->GetValue()));
+    }
+  }
 
-  auto arg = GetArgument().get()->Execute(closure, context);
+  quickening_ = quickening_ == Quickening::UNSEEN ? Observe(arg) : Quickening::GENERIC;
+  return Apply(arg, context);
+}
+
+ObjectHolder Stringify::Apply(const ObjectHolder& arg, Context& context) {
+  string result;
 
   if (!arg) {
     result = "None"s;
@@ -170,8 +328,8 @@ ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
 
   if (arg.TryAs<runtime::ClassInstance>() != nullptr) {
 
-    if (arg.TryAs<runtime::ClassInstance>()->HasMethod("__str__"s, 0)) {
-      auto object = arg.TryAs<runtime::ClassInstance>()->Call("__str__"s, {}, context);
+    if (arg.TryAs<runtime::ClassInstance>()->HasMethod(runtime::STR_METHOD_ID, 0)) {
+      auto object = arg.TryAs<runtime::ClassInstance>()->Call(runtime::STR_METHOD_ID, {}, context);
 
       if (object.TryAs<runtime::Number>() != nullptr) {
         result = std::to_string(object.TryAs<runtime::Number>()->GetValue());
@@ -207,6 +365,28 @@ ObjectHolder Add::Execute(Closure& closure, Context& context) {
   auto lhs = GetLhs().get()->Execute(closure, context);
   auto rhs = GetRhs().get()->Execute(closure, context);
 
+  if (quickening_ == Quickening::NUMBERS) {
+    auto* lhs_number = lhs.TryAs<runtime::Number>();
+    auto* rhs_number = rhs.TryAs<runtime::Number>();
+    if (lhs_number != nullptr && rhs_number != nullptr) {
+      const int result = lhs_number->GetValue() + rhs_number->GetValue();
+      return ObjectHolder::Own(runtime::Number(result));
+    }
+  } else if (quickening_ == Quickening::STRINGS) {
+    auto* lhs_string = lhs.TryAs<runtime::String>();
+    auto* rhs_string = rhs.TryAs<runtime::String>();
+    if (lhs_string != nullptr && rhs_string != nullptr) {
+      return ObjectHolder::Own(
+          runtime::String(lhs_string->GetValue() + rhs_string->GetValue()));
+    }
+  }
+
+  Requicken(lhs, rhs);
+  return Apply(lhs, rhs, context);
+}
+
+ObjectHolder Add::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+
   if (lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr) {
     auto result = lhs.TryAs<runtime::Number>()->GetValue() + rhs.TryAs<runtime::Number>()->GetValue();
     return runtime::ObjectHolder().Own(runtime::Number(result));
@@ -218,8 +398,8 @@ ObjectHolder Add::Execute(Closure& closure, Context& context) {
   }
 
   if (lhs.TryAs<runtime::ClassInstance>() != nullptr) {
-    if (lhs.TryAs<runtime::ClassInstance>()->HasMethod(ADD_METHOD, 1)) {
-      return lhs.TryAs<runtime::ClassInstance>()->Call(ADD_METHOD, {rhs}, context);;
+    if (lhs.TryAs<runtime::ClassInstance>()->HasMethod(runtime::ADD_METHOD_ID, 1)) {
+      return lhs.TryAs<runtime::ClassInstance>()->Call(runtime::ADD_METHOD_ID, {rhs}, context);;
     }
   }
 
@@ -230,6 +410,22 @@ ObjectHolder Sub::Execute(Closure& closure, Context& context) {
   auto lhs = GetLhs().get()->Execute(closure, context);
   auto rhs = GetRhs().get()->Execute(closure, context);
 
+  if (quickening_ == Quickening::NUMBERS) {
+    auto* lhs_number = lhs.TryAs<runtime::Number>();
+    auto* rhs_number = rhs.TryAs<runtime::Number>();
+    if (lhs_number != nullptr && rhs_number != nullptr) {
+      const int result = lhs_number->GetValue() - rhs_number->GetValue();
+      return ObjectHolder::Own(runtime::Number(result));
+    }
+  }
+
+  Requicken(lhs, rhs);
+  return Apply(lhs, rhs, context);
+}
+
+ObjectHolder Sub::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs,
+                          [[maybe_unused]] Context& context) {
+
   if (lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr) {
     auto result = lhs.TryAs<runtime::Number>()->GetValue() - rhs.TryAs<runtime::Number>()->GetValue();
     return runtime::ObjectHolder().Own(runtime::Number(result));
@@ -243,6 +439,22 @@ ObjectHolder Mult::Execute(Closure& closure, Context& context) {
   auto lhs = GetLhs().get()->Execute(closure, context);
   auto rhs = GetRhs().get()->Execute(closure, context);
 
+  if (quickening_ == Quickening::NUMBERS) {
+    auto* lhs_number = lhs.TryAs<runtime::Number>();
+    auto* rhs_number = rhs.TryAs<runtime::Number>();
+    if (lhs_number != nullptr && rhs_number != nullptr) {
+      const int result = lhs_number->GetValue() * rhs_number->GetValue();
+      return ObjectHolder::Own(runtime::Number(result));
+    }
+  }
+
+  Requicken(lhs, rhs);
+  return Apply(lhs, rhs, context);
+}
+
+ObjectHolder Mult::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs,
+                          [[maybe_unused]] Context& context) {
+
   if (lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr) {
     auto result = lhs.TryAs<runtime::Number>()->GetValue() * rhs.TryAs<runtime::Number>()->GetValue();
     return runtime::ObjectHolder().Own(runtime::Number(result));
@@ -255,6 +467,23 @@ ObjectHolder Div::Execute(Closure& closure, Context& context) {
   auto lhs = GetLhs().get()->Execute(closure, context);
   auto rhs = GetRhs().get()->Execute(closure, context);
 
+  if (quickening_ == Quickening::NUMBERS) {
+    auto* lhs_number = lhs.TryAs<runtime::Number>();
+    auto* rhs_number = rhs.TryAs<runtime::Number>();
+    if (lhs_number != nullptr && rhs_number != nullptr
+        && rhs_number->GetValue() != 0) {
+      const int result = lhs_number->GetValue() / rhs_number->GetValue();
+      return ObjectHolder::Own(runtime::Number(result));
+    }
+  }
+
+  Requicken(lhs, rhs);
+  return Apply(lhs, rhs, context);
+}
+
+ObjectHolder Div::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs,
+                          [[maybe_unused]] Context& context) {
+
   if (lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr) {
 
     if (rhs.TryAs<runtime::Number>()->GetValue() != 0) {
@@ -272,6 +501,9 @@ ObjectHolder Compound::Execute(Closure& closure, Context& context) {
 
     for (const auto& stmt : statements_) {
       stmt.get()->Execute(closure, context);
+      if (context.IsReturning()) {
+        break;
+      }
     }
   }
 
@@ -279,13 +511,35 @@ ObjectHolder Compound::Execute(Closure& closure, Context& context) {
   return {};
 }
 
+void Compound::ForEachChild(const ChildVisitor& visit) {
+  for (auto& statement : statements_) {
+    visit(statement);
+  }
+}
+
+vector<unique_ptr<Statement>>& Compound::GetStatements() {
+  return statements_;
+}
+
+const vector<unique_ptr<Statement>>& Compound::GetStatements() const {
+  return statements_;
+}
+
 ObjectHolder Return::Execute(Closure& closure, Context& context) {
-  auto object = statement_.get()->Execute(closure, context);
-  std::stringstream result;
-  object.Get()->Print(result, context);
-  throw runtime_error(result.str());
-    // Заглушка. Реализуйте метод самостоятельно
-    return {};
+  context.SetReturnValue(statement_.get()->Execute(closure, context));
+  return {};
+}
+
+void Return::ForEachChild(const ChildVisitor& visit) {
+  visit(statement_);
+}
+
+unique_ptr<Statement>& Return::GetStatement() {
+  return statement_;
+}
+
+const unique_ptr<Statement>& Return::GetStatement() const {
+  return statement_;
 }
 
 ClassDefinition::ClassDefinition(ObjectHolder cls) : cls_(std::move(cls)) {
@@ -295,8 +549,14 @@ ClassDefinition::ClassDefinition(ObjectHolder cls) : cls_(std::move(cls)) {
 // конструктор
 
 ObjectHolder ClassDefinition::Execute(Closure& closure, [[maybe_unused]] Context& context) {
-    closure[cls_.TryAs<runtime::Class>()->GetName()] = cls_;
-    return closure[cls_.TryAs<runtime::Class>()->GetName()];
+    // cls_ только копируется: повторное объявление класса не создаёт новых объектов
+    ObjectHolder& variable = closure[cls_.TryAs<runtime::Class>()->GetName()];
+    variable = cls_;
+    return variable;
+}
+
+const ObjectHolder& ClassDefinition::GetClass() const {
+  return cls_;
 }
 
 FieldAssignment::FieldAssignment(VariableValue object, std::string field_name,
@@ -308,13 +568,37 @@ FieldAssignment::FieldAssignment(VariableValue object, std::string field_name,
 
 ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context) {
   auto object = object_.Execute(closure, context);
-  Closure& new_closure = object.TryAs<runtime::ClassInstance>()->Fields();
+  auto* instance = object.TryAs<runtime::ClassInstance>();
+  if (instance == nullptr) {
+    throw std::runtime_error("FieldAssignment fail"s);
+  }
+  // Ячейка ищется после вычисления rv: оно может добавить объекту поля
+  ObjectHolder value = rv_.get()->Execute(closure, context);
+  return field_cache_.Insert(instance->Fields(), field_name_) = std::move(value);
+}
 
+void FieldAssignment::ForEachChild(const ChildVisitor& visit) {
+  visit(rv_);
+}
+
+VariableValue& FieldAssignment::GetObject() {
+  return object_;
+}
+
+const VariableValue& FieldAssignment::GetObject() const {
+  return object_;
+}
+
+const std::string& FieldAssignment::GetFieldName() const {
+  return field_name_;
+}
 
-  auto rv = rv_.get()->Execute(closure, context);
-    new_closure[field_name_] = rv_.get()->Execute(closure, context);
+unique_ptr<Statement>& FieldAssignment::GetValue() {
+  return rv_;
+}
 
-  return new_closure[field_name_];
+const unique_ptr<Statement>& FieldAssignment::GetValue() const {
+  return rv_;
 }
 
 IfElse::IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> if_body,
@@ -332,15 +616,47 @@ ObjectHolder IfElse::Execute(Closure& closure, Context& context) {
     return {};
 }
 
+void IfElse::ForEachChild(const ChildVisitor& visit) {
+  visit(condition_);
+  visit(if_body_);
+  visit(else_body_);
+}
+
+unique_ptr<Statement>& IfElse::GetCondition() {
+  return condition_;
+}
+
+const unique_ptr<Statement>& IfElse::GetCondition() const {
+  return condition_;
+}
+
+unique_ptr<Statement>& IfElse::GetIfBody() {
+  return if_body_;
+}
+
+const unique_ptr<Statement>& IfElse::GetIfBody() const {
+  return if_body_;
+}
+
+unique_ptr<Statement>& IfElse::GetElseBody() {
+  return else_body_;
+}
+
+const unique_ptr<Statement>& IfElse::GetElseBody() const {
+  return else_body_;
+}
+
 ObjectHolder Or::Execute(Closure& closure, Context& context) {
-  auto lhs = GetLhs().get()->Execute(closure, context).TryAs<runtime::Bool>();
+  const ObjectHolder lhs_value = GetLhs().get()->Execute(closure, context);
+  auto lhs = lhs_value.TryAs<runtime::Bool>();
 
   if (lhs != nullptr) {
     if (lhs->GetValue())
       return runtime::ObjectHolder().Own(runtime::Bool(true));
   }
 
-  auto rhs = GetRhs().get()->Execute(closure, context).TryAs<runtime::Bool>();
+  const ObjectHolder rhs_value = GetRhs().get()->Execute(closure, context);
+  auto rhs = rhs_value.TryAs<runtime::Bool>();
 
   if (rhs != nullptr) {
       return runtime::ObjectHolder().Own(runtime::Bool(rhs->GetValue()));
@@ -350,16 +666,18 @@ ObjectHolder Or::Execute(Closure& closure, Context& context) {
 }
 
 ObjectHolder And::Execute(Closure& closure, Context& context) {
-  auto lhs = GetLhs().get()->Execute(closure, context).TryAs<runtime::Bool>();
+  const ObjectHolder lhs_value = GetLhs().get()->Execute(closure, context);
+  auto lhs = lhs_value.TryAs<runtime::Bool>();
 
   if (lhs != nullptr) {
     if (lhs->GetValue() == false)
       return runtime::ObjectHolder().Own(runtime::Bool(false));
   }
 
-  auto rhs = GetRhs().get()->Execute(closure, context).TryAs<runtime::Bool>();
+  const ObjectHolder rhs_value = GetRhs().get()->Execute(closure, context);
+  auto rhs = rhs_value.TryAs<runtime::Bool>();
 
-  if (rhs != nullptr) {
+  if (lhs != nullptr && rhs != nullptr) {
       return runtime::ObjectHolder().Own(runtime::Bool(lhs->GetValue() && rhs->GetValue()));
   }
 
@@ -367,7 +685,11 @@ ObjectHolder And::Execute(Closure& closure, Context& context) {
 }
 
 ObjectHolder Not::Execute(Closure& closure, Context& context) {
-  auto argument = GetArgument().get()->Execute(closure, context).TryAs<runtime::Bool>();
+  return Apply(GetArgument().get()->Execute(closure, context));
+}
+
+ObjectHolder Not::Apply(const ObjectHolder& arg) {
+  auto argument = arg.TryAs<runtime::Bool>();
 
   if (argument != nullptr) {
       return runtime::ObjectHolder().Own(runtime::Bool(!argument->GetValue()));
@@ -376,18 +698,106 @@ ObjectHolder Not::Execute(Closure& closure, Context& context) {
   throw runtime_error("Not method fail"s);
 }
 
+ObjectHolder Negate::Execute(Closure& closure, Context& context) {
+  return Apply(GetArgument().get()->Execute(closure, context));
+}
+
+ObjectHolder Negate::Apply(const ObjectHolder& arg) {
+  if (auto number = arg.TryAs<runtime::Number>(); number != nullptr) {
+    return runtime::ObjectHolder().Own(runtime::Number(-number->GetValue()));
+  }
+
+  // Раньше унарный минус разбирался как умножение на -1, сообщение об ошибке сохранено
+  throw runtime_error("Mult method fail"s);
+}
+
+void UnaryOperation::ForEachChild(const ChildVisitor& visit) {
+  visit(argument_);
+}
+
+void BinaryOperation::ForEachChild(const ChildVisitor& visit) {
+  visit(lhs_);
+  visit(rhs_);
+}
+
+void BinaryOperation::Requicken(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+  if (quickening_ != Quickening::UNSEEN) {
+    quickening_ = Quickening::GENERIC;
+    return;
+  }
+  const Quickening observed = Observe(lhs);
+  quickening_ = observed == Observe(rhs) ? observed : Quickening::GENERIC;
+}
+
 Comparison::Comparison(Comparator cmp, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs)
     : BinaryOperation(std::move(lhs), std::move(rhs)),
-      cmp_(std::move(cmp)) {
+      cmp_(std::move(cmp)),
+      kind_(KindOf(cmp_)) {
+  // Пользовательские сравнения выполняются только через cmp_
+  if (kind_ == Kind::UNKNOWN) {
+    quickening_ = Quickening::GENERIC;
+  }
 }
 
 ObjectHolder Comparison::Execute(Closure& closure, Context& context) {
   auto lhs = GetLhs().get()->Execute(closure, context);
   auto rhs = GetRhs().get()->Execute(closure, context);
 
+  if (quickening_ == Quickening::NUMBERS) {
+    auto* lhs_number = lhs.TryAs<runtime::Number>();
+    auto* rhs_number = rhs.TryAs<runtime::Number>();
+    if (lhs_number != nullptr && rhs_number != nullptr) {
+      return ObjectHolder::Own(
+          runtime::Bool(Compare(kind_, lhs_number->GetValue(), rhs_number->GetValue())));
+    }
+  } else if (quickening_ == Quickening::STRINGS) {
+    auto* lhs_string = lhs.TryAs<runtime::String>();
+    auto* rhs_string = rhs.TryAs<runtime::String>();
+    if (lhs_string != nullptr && rhs_string != nullptr) {
+      return ObjectHolder::Own(
+          runtime::Bool(Compare(kind_, lhs_string->GetValue(), rhs_string->GetValue())));
+    }
+  }
+
+  Requicken(lhs, rhs);
   return runtime::ObjectHolder().Own(runtime::Bool(cmp_(lhs, rhs, context)));
 }
 
+Comparison::Kind Comparison::KindOf(const Comparator& cmp) {
+  using Function = bool (*)(const ObjectHolder&, const ObjectHolder&, Context&);
+  const Function* function = cmp.target<Function>();
+  if (function == nullptr) {
+    return Kind::UNKNOWN;
+  }
+  if (*function == runtime::Equal) {
+    return Kind::EQUAL;
+  }
+  if (*function == runtime::NotEqual) {
+    return Kind::NOT_EQUAL;
+  }
+  if (*function == runtime::Less) {
+    return Kind::LESS;
+  }
+  if (*function == runtime::Greater) {
+    return Kind::GREATER;
+  }
+  if (*function == runtime::LessOrEqual) {
+    return Kind::LESS_OR_EQUAL;
+  }
+  if (*function == runtime::GreaterOrEqual) {
+    return Kind::GREATER_OR_EQUAL;
+  }
+  return Kind::UNKNOWN;
+}
+
+const Comparison::Comparator& Comparison::GetComparator() const {
+  return cmp_;
+}
+
+Comparison::Kind Comparison::GetKind() const {
+  return kind_;
+}
+
 NewInstance::NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args) : class__(class_),
     args_(std::move(args)){
 }
@@ -398,33 +808,132 @@ NewInstance::NewInstance(const runtime::Class& class_) : class__(class_) {
 ObjectHolder NewInstance::Execute(Closure& closure, Context& context) {
   auto result = runtime::ObjectHolder::Own(runtime::ClassInstance(class__));
 
-  if (result.TryAs<runtime::ClassInstance>()->HasMethod(INIT_METHOD, args_.size())) {
+  const runtime::Method* init = init_cache_.Find(class__, runtime::INIT_METHOD_ID, args_.size());
+  if (init != nullptr) {
     std::vector<runtime::ObjectHolder> convert_arg;
 
     for (const auto& arg : args_) {
       convert_arg.push_back(arg.get()->Execute(closure, context));
     }
 
-    result.TryAs<runtime::ClassInstance>()->Call(INIT_METHOD, convert_arg, context);
+    result.TryAs<runtime::ClassInstance>()->Call(init, convert_arg, context);
   }
 
     return result;
 }
 
+const runtime::MethodCache& NewInstance::GetCache() const {
+  return init_cache_;
+}
+
+void NewInstance::ForEachChild(const ChildVisitor& visit) {
+  for (auto& arg : args_) {
+    visit(arg);
+  }
+}
+
+const runtime::Class& NewInstance::GetClass() const {
+  return class__;
+}
+
+vector<unique_ptr<Statement>>& NewInstance::GetArgs() {
+  return args_;
+}
+
+const vector<unique_ptr<Statement>>& NewInstance::GetArgs() const {
+  return args_;
+}
+
 MethodBody::MethodBody(std::unique_ptr<Statement>&& body) : body_(std::move(body))  {
 }
 
 ObjectHolder MethodBody::Execute(Closure& closure, Context& context) {
-  try {
-    body_.get()->Execute(closure, context);
-  } catch (runtime_error& e) {
-    return ObjectHolder::Own(runtime::String(e.what()));
+  // Вызов с готовым Closure: переменные тела ищутся по имени, а не в кадре вызывающего метода
+  std::optional<FrameScope> no_frame;
+  if (frame_size_ != 0) {
+    no_frame.emplace(context, nullptr);
   }
+  body_.get()->Execute(closure, context);
 
+  if (context.IsReturning()) {
+    return context.TakeReturnValue();
+  }
+  return {};
+}
 
+ObjectHolder MethodBody::ExecuteMethod(const std::vector<std::string>& formal_params,
+                                       const ObjectHolder& self,
+                                       const std::vector<ObjectHolder>& actual_args,
+                                       Context& context) {
+  if (frame_size_ == 0) {
+    return Statement::ExecuteMethod(formal_params, self, actual_args, context);
+  }
 
+  std::array<std::optional<ObjectHolder>, INLINE_FRAME_SIZE> inline_frame;
+  std::vector<std::optional<ObjectHolder>> heap_frame;
+  std::optional<ObjectHolder>* frame = inline_frame.data();
+  if (frame_size_ > INLINE_FRAME_SIZE) {
+    heap_frame.resize(frame_size_);
+    frame = heap_frame.data();
+  }
+  frame[0] = self;
+  for (size_t i = 0; i < actual_args.size(); ++i) {
+    frame[param_slots_[i]] = actual_args[i];
+  }
 
+  FrameScope scope(context, frame);
+  Closure unused;
+  body_.get()->Execute(unused, context);
+  if (context.IsReturning()) {
+    return context.TakeReturnValue();
+  }
   return {};
 }
 
-}  // namespace ast
\ No newline at end of file
+size_t MethodBody::FrameSize() const {
+  return frame_size_;
+}
+
+void MethodBody::ForEachChild(const ChildVisitor& visit) {
+  visit(body_);
+}
+
+void MethodBody::SetFrame(std::uint32_t frame_size, vector<std::uint32_t> param_slots) {
+  frame_size_ = frame_size;
+  param_slots_ = std::move(param_slots);
+}
+
+unique_ptr<Statement>& MethodBody::GetBody() {
+  return body_;
+}
+
+const unique_ptr<Statement>& MethodBody::GetBody() const {
+  return body_;
+}
+
+Program::Program(std::unique_ptr<Statement> body, size_t folded_nodes)
+    : body_(std::move(body))
+    , folded_nodes_(folded_nodes) {
+}
+
+ObjectHolder Program::Execute(Closure& closure, Context& context) {
+  ObjectHolder result = body_->Execute(closure, context);
+  if (context.IsReturning()) {
+    return context.TakeReturnValue();
+  }
+  return result;
+}
+
+size_t Program::FoldedNodes() const {
+  return folded_nodes_;
+}
+
+void Program::ForEachChild(const ChildVisitor& visit) {
+  visit(body_);
+}
+
+const unique_ptr<Statement>& Program::GetBody() const {
+  return body_;
+}
+
+}  // namespace ast
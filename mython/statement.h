@@ -1,7 +1,10 @@
 #pragma once
 
+#include "field_cache.h"
+#include "method_cache.h"
 #include "runtime.h"
 
+#include <cstdint>
 #include <functional>
 #include <variant>
 
@@ -9,22 +12,37 @@ namespace ast {
 
 using Statement = runtime::Executable;
 
+// Переменная ищется в Closure по имени, а не в ячейке кадра метода
+inline constexpr std::uint32_t NO_SLOT = UINT32_MAX;
+
 // Выражение, возвращающее значение типа T,
 // используется как основа для создания констант
 template <typename T>
 class ValueStatement : public Statement {
 public:
     explicit ValueStatement(T v)
-        : value_(std::move(v)) {
+        : value_(runtime::ObjectHolder::Own(std::move(v))) {
     }
 
+    // ObjectHolder константы создаётся один раз в конструкторе, и вычисление
+    // возвращает его копию без выделения памяти
     runtime::ObjectHolder Execute(runtime::Closure& /*closure*/,
                                   runtime::Context& /*context*/) override {
-        return runtime::ObjectHolder::Share(value_);
+        return value_;
+    }
+
+    // Возвращает объект константы
+    [[nodiscard]] const T& GetConstant() const {
+        return *value_.TryAs<T>();
+    }
+
+    // Возвращает объект с константой
+    [[nodiscard]] const runtime::ObjectHolder& GetHolder() const {
+        return value_;
     }
 
 private:
-    T value_;
+    runtime::ObjectHolder value_;
 };
 
 using NumericConst = ValueStatement<runtime::Number>;
@@ -43,9 +61,23 @@ public:
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    // Возвращает имя переменной либо первое имя цепочки
+    [[nodiscard]] const std::string& GetName() const;
+    // Возвращает имена цепочки id1.id2.id3. Для простой переменной вектор пуст
+    [[nodiscard]] const std::vector<std::string>& GetDottedIds() const;
+    // Назначает первому имени цепочки ячейку кадра метода
+    void SetSlot(std::uint32_t slot);
+
 private:
+    // Возвращает значение поля в конце цепочки, начинающейся с объекта object
+    runtime::ObjectHolder ReadFields(runtime::ObjectHolder object);
+
     std::string var_name_;
     std::vector<std::string> dotted_ids_;
+    // field_caches_[i] - кэш обращения к полю dotted_ids_[i + 1]
+    std::vector<runtime::FieldCache> field_caches_;
+    // Ячейка кадра метода для первого имени цепочки
+    std::uint32_t slot_ = NO_SLOT;
 };
 
 // Присваивает переменной, имя которой задано в параметре var, значение выражения rv
@@ -54,10 +86,19 @@ public:
     Assignment(std::string var, std::unique_ptr<Statement> rv);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    void ForEachChild(const ChildVisitor& visit) override;
+
+    [[nodiscard]] const std::string& GetName() const;
+    [[nodiscard]] std::unique_ptr<Statement>& GetValue();
+    [[nodiscard]] const std::unique_ptr<Statement>& GetValue() const;
+    // Назначает переменной ячейку кадра метода
+    void SetSlot(std::uint32_t slot);
 
 private:
     std::string var_;
     std::unique_ptr<Statement> rv_;
+    // Ячейка кадра метода для переменной var_
+    std::uint32_t slot_ = NO_SLOT;
 };
 
 // Присваивает полю object.field_name значение выражения rv
@@ -66,11 +107,20 @@ public:
     FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    // Объект object не считается дочерней инструкцией: его возвращает GetObject
+    void ForEachChild(const ChildVisitor& visit) override;
+
+    [[nodiscard]] VariableValue& GetObject();
+    [[nodiscard]] const VariableValue& GetObject() const;
+    [[nodiscard]] const std::string& GetFieldName() const;
+    [[nodiscard]] std::unique_ptr<Statement>& GetValue();
+    [[nodiscard]] const std::unique_ptr<Statement>& GetValue() const;
 
 private:
     VariableValue object_;
     std::string field_name_;
     std::unique_ptr<Statement> rv_;
+    runtime::FieldCache field_cache_;
 };
 
 // Значение None
@@ -97,13 +147,23 @@ public:
     // Во время выполнения команды print вывод должен осуществляться в поток, возвращаемый из
     // context.GetOutputStream()
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    void ForEachChild(const ChildVisitor& visit) override;
 
   void SetName(const std::string& name) {
     name_ = name;
   }
 
+    // Имя переменной, которую выводит команда, либо пустая строка
+    [[nodiscard]] const std::string& GetName() const;
+
+    // Выводимое выражение либо список выражений
+    using Arguments = std::variant<std::unique_ptr<Statement>,
+                                   std::vector<std::unique_ptr<Statement>>>;
+    [[nodiscard]] Arguments& GetArguments();
+    [[nodiscard]] const Arguments& GetArguments() const;
+
 private:
-    std::variant<std::unique_ptr<Statement>, std::vector<std::unique_ptr<Statement>>> value_;
+    Arguments value_;
     std::string name_;
 };
 
@@ -114,11 +174,24 @@ public:
                std::vector<std::unique_ptr<Statement>> args);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    void ForEachChild(const ChildVisitor& visit) override;
+
+    // Кэш, в котором вызов запоминает найденные методы
+    [[nodiscard]] const runtime::MethodCache& GetCache() const;
+
+    [[nodiscard]] std::unique_ptr<Statement>& GetObject();
+    [[nodiscard]] const std::unique_ptr<Statement>& GetObject() const;
+    [[nodiscard]] const std::string& GetMethod() const;
+    [[nodiscard]] runtime::MethodId GetMethodId() const;
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& GetArgs();
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const;
 
 private:
     std::unique_ptr<Statement> object_;
     std::string method_;
+    runtime::MethodId method_id_;
     std::vector<std::unique_ptr<Statement>> args_;
+    runtime::MethodCache cache_;
 };
 
 /*
@@ -140,10 +213,33 @@ public:
     NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args);
     // Возвращает объект, содержащий значение типа ClassInstance
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    void ForEachChild(const ChildVisitor& visit) override;
+
+    // Кэш, в котором запоминается метод __init__ класса
+    [[nodiscard]] const runtime::MethodCache& GetCache() const;
+
+    [[nodiscard]] const runtime::Class& GetClass() const;
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& GetArgs();
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const;
 
 private:
     const runtime::Class& class__;
     std::vector<std::unique_ptr<Statement>> args_;
+    runtime::MethodCache init_cache_;
+};
+
+/*
+Специализация узла операции по типам аргументов (quickening).
+Узел создаётся в состоянии UNSEEN. При первом вычислении он запоминает типы аргументов
+и дальше проверяет только их: если типы совпали, результат вычисляется без поиска
+подходящей ветви через dynamic_cast. При первом несовпадении узел навсегда
+переходит в GENERIC и выполняет операцию общим путём
+*/
+enum class Quickening : std::uint8_t {
+    UNSEEN,
+    NUMBERS,
+    STRINGS,
+    GENERIC,
 };
 
 // Базовый класс для унарных операций
@@ -152,6 +248,12 @@ public:
     explicit UnaryOperation(std::unique_ptr<Statement> argument) : argument_(std::move(argument)) {
     }
 
+  void ForEachChild(const ChildVisitor& visit) override;
+
+  std::unique_ptr<Statement>& GetArgument() {
+    return argument_;
+  }
+
   const std::unique_ptr<Statement>& GetArgument() const {
     return argument_;
   }
@@ -165,6 +267,16 @@ class Stringify : public UnaryOperation {
 public:
     using UnaryOperation::UnaryOperation;
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    // Возвращает строковое значение arg
+    static runtime::ObjectHolder Apply(const runtime::ObjectHolder& arg, runtime::Context& context);
+
+    [[nodiscard]] Quickening GetQuickening() const {
+        return quickening_;
+    }
+
+private:
+    Quickening quickening_ = Quickening::UNSEEN;
 };
 
 // Родительский класс Бинарная операция с аргументами lhs и rhs
@@ -175,14 +287,36 @@ public:
         rhs_(std::move(rhs)){
     }
 
+  void ForEachChild(const ChildVisitor& visit) override;
+
+  std::unique_ptr<Statement>& GetLhs() {
+    return lhs_;
+  }
+
   const std::unique_ptr<Statement>& GetLhs() const {
     return lhs_;
   }
 
+  std::unique_ptr<Statement>& GetRhs() {
+    return rhs_;
+  }
+
   const std::unique_ptr<Statement>& GetRhs() const {
     return rhs_;
   }
 
+  // Для Add, Sub, Mult, Div и Comparison - специализация по типам аргументов
+  [[nodiscard]] Quickening GetQuickening() const {
+    return quickening_;
+  }
+
+protected:
+    // Запоминает типы вычисленных аргументов при первом вычислении
+    // и отменяет специализацию при последующих
+    void Requicken(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs);
+
+    Quickening quickening_ = Quickening::UNSEEN;
+
 private:
     std::unique_ptr<Statement> lhs_;
     std::unique_ptr<Statement> rhs_;
@@ -200,6 +334,10 @@ public:
     //  объект1 + объект2, если у объект1 - пользовательский класс с методом _add__(rhs)
     // В противном случае при вычислении выбрасывается runtime_error
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    // Складывает уже вычисленные значения lhs и rhs
+    static runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs,
+                                       const runtime::ObjectHolder& rhs, runtime::Context& context);
 };
 
 // Возвращает результат вычитания аргументов lhs и rhs
@@ -211,6 +349,10 @@ public:
     //  число - число
     // Если lhs и rhs - не числа, выбрасывается исключение runtime_error
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    // Вычитает rhs из lhs, значения аргументов уже вычислены
+    static runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs,
+                                       const runtime::ObjectHolder& rhs, runtime::Context& context);
 };
 
 // Возвращает результат умножения аргументов lhs и rhs
@@ -222,6 +364,10 @@ public:
     //  число * число
     // Если lhs и rhs - не числа, выбрасывается исключение runtime_error
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    // Перемножает уже вычисленные значения lhs и rhs
+    static runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs,
+                                       const runtime::ObjectHolder& rhs, runtime::Context& context);
 };
 
 // Возвращает результат деления lhs и rhs
@@ -234,6 +380,10 @@ public:
     // Если lhs и rhs - не числа, выбрасывается исключение runtime_error
     // Если rhs равен 0, выбрасывается исключение runtime_error
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    // Делит lhs на rhs, значения аргументов уже вычислены
+    static runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs,
+                                       const runtime::ObjectHolder& rhs, runtime::Context& context);
 };
 
 // Возвращает результат вычисления логической операции or над lhs и rhs
@@ -259,6 +409,20 @@ class Not : public UnaryOperation {
 public:
     using UnaryOperation::UnaryOperation;
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    // Возвращает результат операции not над вычисленным значением аргумента
+    static runtime::ObjectHolder Apply(const runtime::ObjectHolder& arg);
+};
+
+// Унарный минус: возвращает число, противоположное аргументу
+// Если аргумент - не число, выбрасывается исключение runtime_error
+class Negate : public UnaryOperation {
+public:
+    using UnaryOperation::UnaryOperation;
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    // Возвращает число, противоположное вычисленному значению аргумента
+    static runtime::ObjectHolder Apply(const runtime::ObjectHolder& arg);
 };
 
 // Составная инструкция (например: тело метода, содержимое ветки if, либо else)
@@ -277,8 +441,13 @@ public:
       statements_.push_back(std::move(stmt));
     }
 
-    // Последовательно выполняет добавленные инструкции. Возвращает None
+    // Последовательно выполняет добавленные инструкции. Возвращает None.
+    // После выполненной инструкции return следующие инструкции не выполняются
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    void ForEachChild(const ChildVisitor& visit) override;
+
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& GetStatements();
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetStatements() const;
 
 private:
     std::vector<std::unique_ptr<Statement>> statements_;
@@ -305,8 +474,27 @@ public:
     // В противном случае возвращает None
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    // Если переменным тела назначены ячейки (см. ResolveLocals), размещает кадр метода
+    // в массиве и выполняет тело с ним. Иначе создаёт Closure, как Executable::ExecuteMethod
+    runtime::ObjectHolder ExecuteMethod(const std::vector<std::string>& formal_params,
+                                       const runtime::ObjectHolder& self,
+                                       const std::vector<runtime::ObjectHolder>& actual_args,
+                                       runtime::Context& context) override;
+    void ForEachChild(const ChildVisitor& visit) override;
+
+    // Возвращает число ячеек в кадре метода либо 0, если переменные ищутся по имени
+    [[nodiscard]] size_t FrameSize() const;
+    // Задаёт кадр метода: число ячеек и ячейки параметров (первой идёт ячейка self)
+    void SetFrame(std::uint32_t frame_size, std::vector<std::uint32_t> param_slots);
+
+    [[nodiscard]] std::unique_ptr<Statement>& GetBody();
+    [[nodiscard]] const std::unique_ptr<Statement>& GetBody() const;
+
 private:
     std::unique_ptr<Statement> body_;
+    std::uint32_t frame_size_ = 0;
+    // Ячейки, в которые попадают self (всегда 0) и параметры метода
+    std::vector<std::uint32_t> param_slots_;
 };
 
 // Выполняет инструкцию return с выражением statement
@@ -318,6 +506,10 @@ public:
     // Останавливает выполнение текущего метода. После выполнения инструкции return метод,
     // внутри которого она была исполнена, должен вернуть результат вычисления выражения statement.
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    void ForEachChild(const ChildVisitor& visit) override;
+
+    [[nodiscard]] std::unique_ptr<Statement>& GetStatement();
+    [[nodiscard]] const std::unique_ptr<Statement>& GetStatement() const;
 
 private:
     std::unique_ptr<Statement> statement_;
@@ -333,6 +525,9 @@ public:
     // конструктор
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    // Возвращает объект с классом
+    [[nodiscard]] const runtime::ObjectHolder& GetClass() const;
+
 private:
     runtime::ObjectHolder cls_;
 };
@@ -345,6 +540,15 @@ public:
            std::unique_ptr<Statement> else_body);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    void ForEachChild(const ChildVisitor& visit) override;
+
+    [[nodiscard]] std::unique_ptr<Statement>& GetCondition();
+    [[nodiscard]] const std::unique_ptr<Statement>& GetCondition() const;
+    [[nodiscard]] std::unique_ptr<Statement>& GetIfBody();
+    [[nodiscard]] const std::unique_ptr<Statement>& GetIfBody() const;
+    // Возвращает ветку else либо nullptr
+    [[nodiscard]] std::unique_ptr<Statement>& GetElseBody();
+    [[nodiscard]] const std::unique_ptr<Statement>& GetElseBody() const;
 
 private:
     std::unique_ptr<Statement> condition_;
@@ -359,14 +563,75 @@ public:
     using Comparator = std::function<bool(const runtime::ObjectHolder&,
                                           const runtime::ObjectHolder&, runtime::Context&)>;
 
+    // Стандартные сравнения из runtime. Для чисел и строк они выполняются без вызова Comparator
+    enum class Kind : std::uint8_t {
+        UNKNOWN,
+        EQUAL,
+        NOT_EQUAL,
+        LESS,
+        GREATER,
+        LESS_OR_EQUAL,
+        GREATER_OR_EQUAL,
+    };
+
     Comparison(Comparator cmp, std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs);
 
     // Вычисляет значение выражений lhs и rhs и возвращает результат работы comparator,
     // приведённый к типу runtime::Bool
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    // Возвращает вид сравнения, которое выполняет cmp, либо UNKNOWN для прочих функций
+    static Kind KindOf(const Comparator& cmp);
+
+    [[nodiscard]] const Comparator& GetComparator() const;
+    [[nodiscard]] Kind GetKind() const;
+
+    // Сравнивает значения чисел или строк. kind не равен UNKNOWN
+    template <typename T>
+    static bool Compare(Kind kind, const T& lhs, const T& rhs) {
+        switch (kind) {
+            case Kind::EQUAL:
+                return lhs == rhs;
+            case Kind::NOT_EQUAL:
+                return lhs != rhs;
+            case Kind::LESS:
+                return lhs < rhs;
+            case Kind::GREATER:
+                return lhs > rhs;
+            case Kind::LESS_OR_EQUAL:
+                return lhs <= rhs;
+            case Kind::GREATER_OR_EQUAL:
+                return lhs >= rhs;
+            case Kind::UNKNOWN:
+                break;
+        }
+        return false;
+    }
+
 private:
     Comparator cmp_;
+    Kind kind_;
+};
+
+// Разобранная программа. Владеет деревом инструкций
+class Program : public Statement {
+public:
+    // folded_nodes - сколько узлов удалила свёртка констант при разборе
+    Program(std::unique_ptr<Statement> body, size_t folded_nodes);
+
+    // Выполняет тело программы. Инструкция return вне метода завершает программу,
+    // и Execute возвращает её значение
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    void ForEachChild(const ChildVisitor& visit) override;
+
+    // Возвращает число узлов, удалённых свёрткой констант
+    [[nodiscard]] size_t FoldedNodes() const;
+
+    [[nodiscard]] const std::unique_ptr<Statement>& GetBody() const;
+
+private:
+    std::unique_ptr<Statement> body_;
+    size_t folded_nodes_;
 };
 
-}  // namespace ast
\ No newline at end of file
+}  // namespace ast
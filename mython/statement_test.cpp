@@ -1,3 +1,7 @@
+#include "allocation_counter.h"
+#include "bytecode.h"
+#include "linear.h"
+#include "optimize.h"
 #include "statement.h"
 
 #include <test_runner.h>
@@ -309,6 +313,27 @@ void TestCompound() {
     ASSERT(context.output.str().empty());
 }
 
+void TestReturn() {
+    runtime::DummyContext context;
+
+    // if True:
+    //   return x
+    // print 'unreachable'
+    auto if_body = make_unique<Compound>(make_unique<Return>(make_unique<VariableValue>("x"s)));
+    MethodBody body(make_unique<Compound>(
+        make_unique<IfElse>(make_unique<BoolConst>(runtime::Bool(true)), std::move(if_body),
+                            nullptr),
+        make_unique<Print>(make_unique<StringConst>("unreachable"s))));
+
+    Closure closure = {{"x"s, ObjectHolder::Own(runtime::String("42"s))}};
+    auto result = body.Execute(closure, context);
+
+    // Возвращается сам объект, а не его копия
+    ASSERT(result.Get() == closure.at("x"s).Get());
+    ASSERT(context.output.str().empty());
+    ASSERT(!context.IsReturning());
+}
+
 void TestFields() {
     runtime::DummyContext context;
 
@@ -454,6 +479,372 @@ void TestNot() {
     test_not(false);
 }
 
+void TestQuickening() {
+    runtime::DummyContext context;
+    Closure closure = {{"x"s, ObjectHolder::Own(runtime::Number(7))},
+                       {"y"s, ObjectHolder::Own(runtime::Number(2))}};
+
+    Add add(make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+    ASSERT(add.GetQuickening() == Quickening::UNSEEN);
+    ASSERT_OBJECT_VALUE_EQUAL(add.Execute(closure, context), 9);
+    ASSERT(add.GetQuickening() == Quickening::NUMBERS);
+    ASSERT_OBJECT_VALUE_EQUAL(add.Execute(closure, context), 9);
+    ASSERT(add.GetQuickening() == Quickening::NUMBERS);
+
+    Div div(make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+    Comparison less(runtime::Less, make_unique<VariableValue>("x"s),
+                    make_unique<VariableValue>("y"s));
+    Stringify str(make_unique<VariableValue>("x"s));
+    ASSERT_OBJECT_VALUE_EQUAL(div.Execute(closure, context), 3);
+    ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure, context), "False"s);
+    ASSERT_OBJECT_VALUE_EQUAL(str.Execute(closure, context), "7"s);
+    ASSERT(less.GetQuickening() == Quickening::NUMBERS);
+    ASSERT(str.GetQuickening() == Quickening::NUMBERS);
+
+    // Деление на ноль в узле, специализированном для чисел, по-прежнему - ошибка
+    closure["y"s] = ObjectHolder::Own(runtime::Number(0));
+    try {
+        div.Execute(closure, context);
+        ASSERT(false);
+    } catch (const runtime_error&) {
+    } catch (...) {
+        ASSERT(false);
+    }
+
+    // Аргументы другого типа вычисляются общим путём, и узел теряет специализацию
+    closure["x"s] = ObjectHolder::Own(runtime::String("ab"s));
+    closure["y"s] = ObjectHolder::Own(runtime::String("b"s));
+    ASSERT_OBJECT_VALUE_EQUAL(add.Execute(closure, context), "abb"s);
+    ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure, context), "True"s);
+    ASSERT_OBJECT_VALUE_EQUAL(str.Execute(closure, context), "ab"s);
+    ASSERT(add.GetQuickening() == Quickening::GENERIC);
+    ASSERT(less.GetQuickening() == Quickening::GENERIC);
+    ASSERT(str.GetQuickening() == Quickening::GENERIC);
+
+    // Сравнение с пользовательской функцией не специализируется
+    Comparison custom([](const ObjectHolder&, const ObjectHolder&, runtime::Context&) {
+                          return true;
+                      },
+                      make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+    ASSERT(custom.GetQuickening() == Quickening::GENERIC);
+    ASSERT_OBJECT_VALUE_EQUAL(custom.Execute(closure, context), "True"s);
+}
+
+void TestArithmeticWithoutAllocations() {
+    runtime::DummyContext context;
+    Closure closure = {{"x"s, ObjectHolder::Own(runtime::Number(7))},
+                       {"y"s, ObjectHolder::Own(runtime::Number(2))}};
+    // (x + y) * y - x / y < x
+    Comparison expression(
+        runtime::Less,
+        make_unique<Sub>(make_unique<Mult>(make_unique<Add>(make_unique<VariableValue>("x"s),
+                                                            make_unique<VariableValue>("y"s)),
+                                           make_unique<VariableValue>("y"s)),
+                         make_unique<Div>(make_unique<VariableValue>("x"s),
+                                          make_unique<VariableValue>("y"s))),
+        make_unique<VariableValue>("x"s));
+
+    ObjectHolder result = expression.Execute(closure, context);
+    runtime::AllocationCounter allocations;
+    for (int i = 0; i < 1000; ++i) {
+        result = expression.Execute(closure, context);
+    }
+
+    const size_t allocated = allocations.Count();
+    ASSERT_EQUAL(allocated, 0U);
+    ASSERT_OBJECT_VALUE_EQUAL(result, "False"s);
+}
+
+void TestConstantsWithoutAllocations() {
+    runtime::DummyContext context;
+    Closure closure;
+    // def method():
+    //   return 'abc' if True else 1 + 2
+    MethodBody body(make_unique<IfElse>(
+        make_unique<BoolConst>(runtime::Bool(true)),
+        make_unique<Return>(make_unique<StringConst>("abc"s)),
+        make_unique<Return>(make_unique<Add>(make_unique<NumericConst>(1),
+                                             make_unique<NumericConst>(2)))));
+    ClassDefinition definition(
+        ObjectHolder::Own(runtime::Class("Empty"s, vector<runtime::Method>{}, nullptr)));
+
+    ObjectHolder result = body.Execute(closure, context);
+    definition.Execute(closure, context);
+    runtime::AllocationCounter allocations;
+    for (int i = 0; i < 1'000'000; ++i) {
+        result = body.Execute(closure, context);
+    }
+    definition.Execute(closure, context);
+
+    const size_t allocated = allocations.Count();
+    ASSERT_EQUAL(allocated, 0U);
+    ASSERT_OBJECT_VALUE_EQUAL(result, "abc"s);
+    ASSERT(closure.at("Empty"s).TryAs<runtime::Class>() != nullptr);
+}
+
+void TestMethodCallCache() {
+    // Классы C0..C5 с методом get(), который возвращает номер класса
+    vector<unique_ptr<runtime::Class>> classes;
+    for (int i = 0; i < 6; ++i) {
+        vector<runtime::Method> methods;
+        methods.push_back(
+            {"get"s, {}, make_unique<MethodBody>(make_unique<Return>(make_unique<NumericConst>(i)))});
+        classes.push_back(
+            make_unique<runtime::Class>("C"s + to_string(i), std::move(methods), nullptr));
+    }
+
+    runtime::DummyContext context;
+    Closure closure;
+    const auto call_on = [&](Statement& call, size_t i) {
+        closure["x"s] = ObjectHolder::Own(runtime::ClassInstance(*classes[i]));
+        return call.Execute(closure, context);
+    };
+
+    MethodCall call(make_unique<VariableValue>("x"s), "get"s, {});
+    // Мономорфный вызов: метод ищется в классе только в первый раз
+    for (int n = 0; n < 3; ++n) {
+        ASSERT_OBJECT_VALUE_EQUAL(call_on(call, 0), 0);
+    }
+    ASSERT_EQUAL(call.GetCache().Misses(), 1U);
+    ASSERT_EQUAL(call.GetCache().Hits(), 2U);
+
+    // Полиморфный: кэш запоминает до четырёх классов
+    for (size_t i = 1; i < 4; ++i) {
+        ASSERT_OBJECT_VALUE_EQUAL(call_on(call, i), i);
+    }
+    ASSERT_OBJECT_VALUE_EQUAL(call_on(call, 2), 2);
+    ASSERT_EQUAL(call.GetCache().Size(), 4U);
+    ASSERT_EQUAL(call.GetCache().Misses(), 4U);
+    ASSERT_EQUAL(call.GetCache().Hits(), 3U);
+
+    // Пятый класс делает вызов мегаморфным, и дальше метод всегда ищется в классе
+    ASSERT_OBJECT_VALUE_EQUAL(call_on(call, 4), 4);
+    ASSERT_OBJECT_VALUE_EQUAL(call_on(call, 0), 0);
+    ASSERT(call.GetCache().IsMegamorphic());
+    ASSERT_EQUAL(call.GetCache().Misses(), 6U);
+    ASSERT_EQUAL(call.GetCache().Hits(), 3U);
+
+    auto linear = Linearize(make_unique<MethodCall>(make_unique<VariableValue>("x"s), "get"s,
+                                                    vector<unique_ptr<Statement>>{}));
+    auto bytecode = Compile(make_unique<MethodCall>(make_unique<VariableValue>("x"s), "get"s,
+                                                    vector<unique_ptr<Statement>>{}));
+    for (size_t i : {5, 5, 1, 5}) {
+        ASSERT_OBJECT_VALUE_EQUAL(call_on(*linear, i), i);
+        ASSERT_OBJECT_VALUE_EQUAL(call_on(*bytecode, i), i);
+    }
+    ASSERT_EQUAL(linear->CacheMisses(), 2U);
+    ASSERT_EQUAL(linear->CacheHits(), 2U);
+    ASSERT_EQUAL(bytecode->CacheMisses(), 2U);
+    ASSERT_EQUAL(bytecode->CacheHits(), 2U);
+}
+
+void TestLinearize() {
+    // Инструкция, которую линейное представление не знает и вызывает как есть
+    struct CountCalls : Statement {
+        explicit CountCalls(int& calls)
+            : calls(calls) {
+        }
+        ObjectHolder Execute(Closure& /*closure*/, runtime::Context& /*context*/) override {
+            ++calls;
+            return ObjectHolder::Own(runtime::String("opaque"s));
+        }
+        int& calls;
+    };
+
+    int calls = 0;
+    vector<unique_ptr<Statement>> args;
+    args.push_back(make_unique<VariableValue>("x"s));
+    args.push_back(make_unique<CountCalls>(calls));
+    args.push_back(make_unique<None>());
+
+    // x = 1 + 2 * 3
+    // print x, <opaque>, None
+    auto code = Linearize(make_unique<Compound>(
+        make_unique<Assignment>(
+            "x"s, make_unique<Add>(make_unique<NumericConst>(1),
+                                   make_unique<Mult>(make_unique<NumericConst>(2),
+                                                     make_unique<NumericConst>(3)))),
+        make_unique<Print>(std::move(args))));
+    ASSERT_EQUAL(code->Size(), 11U);
+
+    Closure closure;
+    runtime::DummyContext context;
+    ASSERT(!code->Execute(closure, context));
+    ASSERT_EQUAL(context.output.str(), "7 opaque None\n"s);
+    ASSERT_OBJECT_VALUE_EQUAL(closure.at("x"s), 7);
+    ASSERT_EQUAL(calls, 1);
+}
+
+void TestLinearizeMethod() {
+    // def sum(x, y):
+    //   s = x + y
+    //   return s
+    auto sum = LinearizeMethod(
+        make_unique<MethodBody>(make_unique<Compound>(
+            make_unique<Assignment>("s"s, make_unique<Add>(make_unique<VariableValue>("x"s),
+                                                           make_unique<VariableValue>("y"s))),
+            make_unique<Return>(make_unique<VariableValue>("s"s)))),
+        {"x"s, "y"s});
+    // self, x, y, s
+    ASSERT_EQUAL(sum->FrameSize(), 4U);
+
+    runtime::DummyContext context;
+    ObjectHolder result = sum->ExecuteMethod(
+        {"x"s, "y"s}, ObjectHolder::None(),
+        {ObjectHolder::Own(runtime::Number(2)), ObjectHolder::Own(runtime::Number(3))}, context);
+    ASSERT_OBJECT_VALUE_EQUAL(result, 5);
+
+    // def undefined():
+    //   return z
+    auto undefined = LinearizeMethod(
+        make_unique<MethodBody>(make_unique<Return>(make_unique<VariableValue>("z"s))), {});
+    // Ошибка выполнения не становится результатом метода, а передаётся дальше
+    ASSERT_THROWS(undefined->ExecuteMethod({}, ObjectHolder::None(), {}, context), runtime_error);
+
+    // Тело с print x ищет переменные по имени
+    auto print = LinearizeMethod(make_unique<MethodBody>(Print::Variable("x"s)), {"x"s});
+    ASSERT_EQUAL(print->FrameSize(), 0U);
+    print->ExecuteMethod({"x"s}, ObjectHolder::None(), {ObjectHolder::Own(runtime::Number(7))},
+                         context);
+    ASSERT_EQUAL(context.output.str(), "7\n"s);
+}
+
+void TestResolveLocals() {
+    // def sum(x, y):
+    //   s = x + y
+    //   return s
+    MethodBody sum(make_unique<Compound>(
+        make_unique<Assignment>("s"s, make_unique<Add>(make_unique<VariableValue>("x"s),
+                                                       make_unique<VariableValue>("y"s))),
+        make_unique<Return>(make_unique<VariableValue>("s"s))));
+    // self, x, y, s
+    ASSERT_EQUAL(ResolveLocals(sum, {"x"s, "y"s}), 4U);
+    ASSERT_EQUAL(sum.FrameSize(), 4U);
+
+    runtime::DummyContext context;
+    ObjectHolder result = sum.ExecuteMethod(
+        {"x"s, "y"s}, ObjectHolder::None(),
+        {ObjectHolder::Own(runtime::Number(2)), ObjectHolder::Own(runtime::Number(3))}, context);
+    ASSERT_OBJECT_VALUE_EQUAL(result, 5);
+    ASSERT(context.GetFrame() == nullptr);
+
+    // Выполнение с готовым Closure по-прежнему ищет переменные по имени
+    Closure closure = {{"x"s, ObjectHolder::Own(runtime::Number(4))},
+                       {"y"s, ObjectHolder::Own(runtime::Number(1))}};
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 5);
+    ASSERT_OBJECT_VALUE_EQUAL(closure.at("s"s), 5);
+
+    // def undefined():
+    //   return z
+    MethodBody undefined(make_unique<Return>(make_unique<VariableValue>("z"s)));
+    ASSERT_EQUAL(ResolveLocals(undefined, {}), 2U);
+    ASSERT_THROWS(undefined.ExecuteMethod({}, ObjectHolder::None(), {}, context), runtime_error);
+    ASSERT(context.GetFrame() == nullptr);
+
+    // Тело с print x ищет переменные по имени
+    MethodBody print(Print::Variable("x"s));
+    ASSERT_EQUAL(ResolveLocals(print, {"x"s}), 0U);
+    print.ExecuteMethod({"x"s}, ObjectHolder::None(), {ObjectHolder::Own(runtime::Number(7))},
+                        context);
+    ASSERT_EQUAL(context.output.str(), "7\n"s);
+
+    // Объявление класса записывает его имя в Closure, даже внутри ветки if
+    MethodBody definition(make_unique<IfElse>(
+        make_unique<BoolConst>(runtime::Bool(true)),
+        make_unique<ClassDefinition>(ObjectHolder::Own(runtime::Class("A"s, {}, nullptr))),
+        nullptr));
+    ASSERT_EQUAL(ResolveLocals(definition, {}), 0U);
+    ASSERT_EQUAL(definition.FrameSize(), 0U);
+}
+
+void TestCompileMethod() {
+    // def max(x, y):
+    //   if x < y:
+    //     return y
+    //   return x
+    auto max = CompileMethod(
+        make_unique<MethodBody>(make_unique<Compound>(
+            make_unique<IfElse>(make_unique<Comparison>(runtime::Less,
+                                                        make_unique<VariableValue>("x"s),
+                                                        make_unique<VariableValue>("y"s)),
+                                make_unique<Return>(make_unique<VariableValue>("y"s)), nullptr),
+            make_unique<Return>(make_unique<VariableValue>("x"s)))),
+        {"x"s, "y"s});
+    ASSERT_EQUAL(max->FrameSize(), 3U);
+
+    runtime::DummyContext context;
+    const auto call = [&](ObjectHolder x, ObjectHolder y) {
+        return max->ExecuteMethod({"x"s, "y"s}, ObjectHolder::None(), {std::move(x), std::move(y)},
+                                  context);
+    };
+    ASSERT_OBJECT_VALUE_EQUAL(
+        call(ObjectHolder::Own(runtime::Number(2)), ObjectHolder::Own(runtime::Number(3))), 3);
+    ASSERT_OBJECT_VALUE_EQUAL(
+        call(ObjectHolder::Own(runtime::Number(4)), ObjectHolder::Own(runtime::Number(3))), 4);
+    ASSERT_THROWS(
+        call(ObjectHolder::Own(runtime::Number(4)), ObjectHolder::Own(runtime::String("a"s))),
+        runtime_error);
+
+    // Вне тела метода return, как и в дереве, завершает выполнение кода
+    auto top_level = Compile(
+        make_unique<Compound>(make_unique<Return>(make_unique<NumericConst>(5)),
+                              make_unique<Print>(make_unique<NumericConst>(6))));
+    Closure closure;
+    ASSERT_OBJECT_VALUE_EQUAL(top_level->Execute(closure, context), 5);
+    ASSERT(context.output.str().empty());
+}
+
+void TestFoldConstants() {
+    unique_ptr<Statement> tree = make_unique<Compound>(
+        // a = 1 + 2 * 3
+        make_unique<Assignment>(
+            "a"s, make_unique<Add>(make_unique<NumericConst>(1),
+                                   make_unique<Mult>(make_unique<NumericConst>(2),
+                                                     make_unique<NumericConst>(3)))),
+        // b = -8
+        make_unique<Assignment>("b"s, make_unique<Negate>(make_unique<NumericConst>(-8))),
+        // c = not 'a' < 'b'
+        make_unique<Assignment>(
+            "c"s, make_unique<Not>(make_unique<Comparison>(runtime::Less,
+                                                          make_unique<StringConst>("a"s),
+                                                          make_unique<StringConst>("b"s)))),
+        // d = True or undefined
+        make_unique<Assignment>(
+            "d"s, make_unique<Or>(make_unique<BoolConst>(true), make_unique<VariableValue>("x"s))),
+        // if False: print 'dead'
+        make_unique<IfElse>(make_unique<BoolConst>(false),
+                            make_unique<Print>(make_unique<StringConst>("dead"s)), nullptr),
+        // Произвольное сравнение может иметь побочные эффекты и не сворачивается
+        make_unique<Assignment>(
+            "e"s, make_unique<Comparison>(
+                      [](const ObjectHolder&, const ObjectHolder&, runtime::Context& context) {
+                          context.GetOutputStream() << "compared"sv;
+                          return true;
+                      },
+                      make_unique<NumericConst>(1), make_unique<NumericConst>(2))),
+        // Деление на ноль остаётся ошибкой времени выполнения
+        make_unique<Assignment>(
+            "f"s, make_unique<Div>(make_unique<NumericConst>(1), make_unique<NumericConst>(0))));
+
+    ASSERT_EQUAL(FoldConstants(tree), 13U);
+
+    Closure closure;
+    runtime::DummyContext context;
+    try {
+        tree->Execute(closure, context);
+        ASSERT(false);
+    } catch (const runtime_error&) {
+    }
+    ASSERT_OBJECT_VALUE_EQUAL(closure.at("a"s), 7);
+    ASSERT_OBJECT_VALUE_EQUAL(closure.at("b"s), 8);
+    ASSERT_OBJECT_VALUE_EQUAL(closure.at("c"s), "False"s);
+    ASSERT_OBJECT_VALUE_EQUAL(closure.at("d"s), "True"s);
+    ASSERT_EQUAL(context.output.str(), "compared"s);
+    ASSERT(closure.count("f"s) == 0);
+
+    ASSERT_EQUAL(FoldConstants(tree), 0U);
+}
+
 }  // namespace
 
 void RunUnitTests(TestRunner& tr) {
@@ -471,12 +862,22 @@ void RunUnitTests(TestRunner& tr) {
     RUN_TEST(tr, ast::TestSuccessfulClassInstanceAdd);
     RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod);
     RUN_TEST(tr, ast::TestCompound);
+    RUN_TEST(tr, ast::TestReturn);
     RUN_TEST(tr, ast::TestFields);
     RUN_TEST(tr, ast::TestBaseClass);
     RUN_TEST(tr, ast::TestInheritance);
     RUN_TEST(tr, ast::TestOr);
     RUN_TEST(tr, ast::TestAnd);
     RUN_TEST(tr, ast::TestNot);
+    RUN_TEST(tr, ast::TestQuickening);
+    RUN_TEST(tr, ast::TestArithmeticWithoutAllocations);
+    RUN_TEST(tr, ast::TestConstantsWithoutAllocations);
+    RUN_TEST(tr, ast::TestMethodCallCache);
+    RUN_TEST(tr, ast::TestLinearize);
+    RUN_TEST(tr, ast::TestLinearizeMethod);
+    RUN_TEST(tr, ast::TestResolveLocals);
+    RUN_TEST(tr, ast::TestCompileMethod);
+    RUN_TEST(tr, ast::TestFoldConstants);
 }
 
 }  // namespace ast